@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <pthread.h>
 #include "linear.h"
 #include "tron.h"
 typedef signed char schar;
@@ -43,10 +44,16 @@ static void info(const char *fmt,...)
 static void info(const char *fmt,...) {}
 #endif
 
+// Instances of l2r_lr_fun are split into nr_thread contiguous shards.
+// Each shard is processed by its own thread and writes its partial sums to
+// its own buffer; the buffers are reduced in shard order afterwards, so the
+// result only depends on nr_thread, not on thread scheduling.
+// The worker threads are created once per object and woken for each
+// operation; shard 0 always runs in the calling thread.
 class l2r_lr_fun : public function
 {
 public:
-	l2r_lr_fun(const problem *prob, double Cp, double Cn);
+	l2r_lr_fun(const problem *prob, double Cp, double Cn, int nr_thread = 1);
 	~l2r_lr_fun();
 
 	double fun(double *w);
@@ -59,23 +66,57 @@ private:
 	void Xv(double *v, double *Xv);
 	void XTv(double *v, double *XTv);
 
+	enum { SHARD_XV, SHARD_XTV, SHARD_LOSS, SHARD_GRAD_Z };
+	struct shard
+	{
+		l2r_lr_fun *fun_obj;
+		int op;
+		int begin, end;
+		double *v;
+		double *out;
+		double sum;
+	};
+	static void *run_shard(void *arg);
+	static void *worker(void *arg);
+	void run_shards(int op, double *v, double *out, double *sums);
+
 	double *C;
 	double *z;
 	double *D;
 	const problem *prob;
+	int nr_thread;
+	double *XTv_buf;
+
+	shard *shards;
+	pthread_t *threads;
+	bool *created;
+	pthread_mutex_t lock;
+	pthread_cond_t start_cond;	// signalled when generation changes or quit is set
+	pthread_cond_t done_cond;	// signalled when pending drops to 0
+	int generation;
+	int pending;
+	bool quit;
 };
 
-l2r_lr_fun::l2r_lr_fun(const problem *prob, double Cp, double Cn)
+l2r_lr_fun::l2r_lr_fun(const problem *prob, double Cp, double Cn, int nr_thread)
 {
 	int i;
 	int l=prob->l;
 	int *y=prob->y;
 
 	this->prob = prob;
+	this->nr_thread = max(1, min(nr_thread, l));
 
 	z = new double[l];
 	D = new double[l];
 	C = new double[l];
+	XTv_buf = NULL;
+	shards = NULL;
+	threads = NULL;
+	created = NULL;
+	generation = 0;
+	pending = 0;
+	quit = false;
 
 	for (i=0; i<l; i++)
 	{
@@ -84,32 +125,211 @@ l2r_lr_fun::l2r_lr_fun(const problem *prob, double Cp, double Cn)
 		else
 			C[i] = Cn;
 	}
+
+	if (this->nr_thread == 1)
+		return;
+
+	XTv_buf = new double[(size_t)(this->nr_thread-1)*get_nr_variable()];
+	shards = new shard[this->nr_thread];
+	threads = new pthread_t[this->nr_thread];
+	created = new bool[this->nr_thread];
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&start_cond, NULL);
+	pthread_cond_init(&done_cond, NULL);
+
+	// shard t covers instances [t*l/nr_thread, (t+1)*l/nr_thread)
+	for(int t=0;t<this->nr_thread;t++)
+	{
+		shards[t].fun_obj = this;
+		shards[t].op = SHARD_XV;
+		shards[t].begin = (int)((long long)l*t/this->nr_thread);
+		shards[t].end = (int)((long long)l*(t+1)/this->nr_thread);
+		shards[t].v = NULL;
+		shards[t].out = NULL;
+		shards[t].sum = 0;
+	}
+	created[0] = false;
+	for(int t=1;t<this->nr_thread;t++)
+		created[t] = (pthread_create(&threads[t], NULL, worker, &shards[t]) == 0);
 }
 
 l2r_lr_fun::~l2r_lr_fun()
 {
+	if (nr_thread > 1)
+	{
+		pthread_mutex_lock(&lock);
+		quit = true;
+		pthread_cond_broadcast(&start_cond);
+		pthread_mutex_unlock(&lock);
+		for(int t=1;t<nr_thread;t++)
+			if (created[t])
+				pthread_join(threads[t], NULL);
+		pthread_cond_destroy(&done_cond);
+		pthread_cond_destroy(&start_cond);
+		pthread_mutex_destroy(&lock);
+	}
+	delete[] created;
+	delete[] threads;
+	delete[] shards;
 	delete[] z;
 	delete[] D;
 	delete[] C;
+	delete[] XTv_buf;
+}
+
+void *l2r_lr_fun::worker(void *arg)
+{
+	shard *sh = (shard *)arg;
+	l2r_lr_fun *f = sh->fun_obj;
+	int seen = 0;
+
+	pthread_mutex_lock(&f->lock);
+	for(;;)
+	{
+		while (f->generation == seen && !f->quit)
+			pthread_cond_wait(&f->start_cond, &f->lock);
+		if (f->quit)
+			break;
+		seen = f->generation;
+		pthread_mutex_unlock(&f->lock);
+
+		run_shard(sh);
+
+		pthread_mutex_lock(&f->lock);
+		if (--f->pending == 0)
+			pthread_cond_signal(&f->done_cond);
+	}
+	pthread_mutex_unlock(&f->lock);
+	return NULL;
+}
+
+void *l2r_lr_fun::run_shard(void *arg)
+{
+	shard *sh = (shard *)arg;
+	const problem *prob = sh->fun_obj->prob;
+	feature_node **x = prob->x;
+	int *y = prob->y;
+	double *C = sh->fun_obj->C;
+	double *z = sh->fun_obj->z;
+	double *D = sh->fun_obj->D;
+	int i;
+
+	switch(sh->op)
+	{
+		case SHARD_XV:
+			for(i=sh->begin;i<sh->end;i++)
+			{
+				feature_node *s=x[i];
+				sh->out[i]=0;
+				while(s->index!=-1)
+				{
+					sh->out[i]+=sh->v[s->index-1]*s->value;
+					s++;
+				}
+			}
+			break;
+		case SHARD_XTV:
+			for(i=0;i<prob->n;i++)
+				sh->out[i]=0;
+			for(i=sh->begin;i<sh->end;i++)
+			{
+				feature_node *s=x[i];
+				while(s->index!=-1)
+				{
+					sh->out[s->index-1]+=sh->v[i]*s->value;
+					s++;
+				}
+			}
+			break;
+		case SHARD_LOSS:
+			sh->sum=0;
+			for(i=sh->begin;i<sh->end;i++)
+			{
+				double yz = y[i]*z[i];
+				if (yz >= 0)
+					sh->sum += C[i]*log(1 + exp(-yz));
+				else
+					sh->sum += C[i]*(-yz+log(1 + exp(yz)));
+			}
+			break;
+		case SHARD_GRAD_Z:
+			for(i=sh->begin;i<sh->end;i++)
+			{
+				z[i] = 1/(1 + exp(-y[i]*z[i]));
+				D[i] = z[i]*(1-z[i]);
+				z[i] = C[i]*(z[i]-1)*y[i];
+			}
+			break;
+	}
+	return NULL;
 }
 
+// For SHARD_XTV, shard 0 writes to out and shard t>0 to its slice of XTv_buf.
+void l2r_lr_fun::run_shards(int op, double *v, double *out, double *sums)
+{
+	int t;
+
+	pthread_mutex_lock(&lock);
+	for(t=0;t<nr_thread;t++)
+	{
+		shards[t].op = op;
+		shards[t].v = v;
+		shards[t].out = out;
+		if (op == SHARD_XTV && t > 0)
+			shards[t].out = XTv_buf + (size_t)(t-1)*get_nr_variable();
+		shards[t].sum = 0;
+	}
+	pending = 0;
+	for(t=1;t<nr_thread;t++)
+		if (created[t])
+			pending++;
+	generation++;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&lock);
+
+	// shard 0 runs in the calling thread, and so does any shard whose thread could not be created
+	run_shard(&shards[0]);
+	for(t=1;t<nr_thread;t++)
+		if (!created[t])
+			run_shard(&shards[t]);
+
+	pthread_mutex_lock(&lock);
+	while (pending > 0)
+		pthread_cond_wait(&done_cond, &lock);
+	pthread_mutex_unlock(&lock);
+
+	if (sums != NULL)
+		for(t=0;t<nr_thread;t++)
+			sums[t] = shards[t].sum;
+}
 
 double l2r_lr_fun::fun(double *w)
 {
 	int i;
 	double f=0;
-	int *y=prob->y;
-	int l=prob->l;
 	int w_size=get_nr_variable();
 
 	Xv(w, z);
-	for(i=0;i<l;i++)
+	if (nr_thread == 1)
 	{
-		double yz = y[i]*z[i];
-		if (yz >= 0)
-			f += C[i]*log(1 + exp(-yz));
-		else
-			f += C[i]*(-yz+log(1 + exp(yz)));
+		int *y=prob->y;
+		int l=prob->l;
+		for(i=0;i<l;i++)
+		{
+			double yz = y[i]*z[i];
+			if (yz >= 0)
+				f += C[i]*log(1 + exp(-yz));
+			else
+				f += C[i]*(-yz+log(1 + exp(yz)));
+		}
+	}
+	else
+	{
+		double *sums = new double[nr_thread];
+		run_shards(SHARD_LOSS, NULL, NULL, sums);
+		for(i=0;i<nr_thread;i++)
+			f += sums[i];
+		delete[] sums;
 	}
 	f = 2*f;
 	for(i=0;i<w_size;i++)
@@ -122,16 +342,21 @@ double l2r_lr_fun::fun(double *w)
 void l2r_lr_fun::grad(double *w, double *g)
 {
 	int i;
-	int *y=prob->y;
-	int l=prob->l;
 	int w_size=get_nr_variable();
 
-	for(i=0;i<l;i++)
+	if (nr_thread == 1)
 	{
-		z[i] = 1/(1 + exp(-y[i]*z[i]));
-		D[i] = z[i]*(1-z[i]);
-		z[i] = C[i]*(z[i]-1)*y[i];
+		int *y=prob->y;
+		int l=prob->l;
+		for(i=0;i<l;i++)
+		{
+			z[i] = 1/(1 + exp(-y[i]*z[i]));
+			D[i] = z[i]*(1-z[i]);
+			z[i] = C[i]*(z[i]-1)*y[i];
+		}
 	}
+	else
+		run_shards(SHARD_GRAD_Z, NULL, NULL, NULL);
 	XTv(z, g);
 
 	for(i=0;i<w_size;i++)
@@ -166,6 +391,12 @@ void l2r_lr_fun::Xv(double *v, double *Xv)
 	int l=prob->l;
 	feature_node **x=prob->x;
 
+	if (nr_thread > 1)
+	{
+		run_shards(SHARD_XV, v, Xv, NULL);
+		return;
+	}
+
 	for(i=0;i<l;i++)
 	{
 		feature_node *s=x[i];
@@ -185,6 +416,18 @@ void l2r_lr_fun::XTv(double *v, double *XTv)
 	int w_size=get_nr_variable();
 	feature_node **x=prob->x;
 
+	if (nr_thread > 1)
+	{
+		run_shards(SHARD_XTV, v, XTv, NULL);
+		for(int t=1;t<nr_thread;t++)
+		{
+			double *buf = XTv_buf + (size_t)(t-1)*w_size;
+			for(i=0;i<w_size;i++)
+				XTv[i] += buf[i];
+		}
+		return;
+	}
+
 	for(i=0;i<w_size;i++)
 		XTv[i]=0;
 	for(i=0;i<l;i++)
@@ -1837,7 +2080,7 @@ static void train_one(const problem *prob, const parameter *param, double *w, do
 	{
 		case L2R_LR:
 		{
-			fun_obj=new l2r_lr_fun(prob, Cp, Cn);
+			fun_obj=new l2r_lr_fun(prob, Cp, Cn, param->nr_thread);
 			TRON tron_obj(fun_obj, eps*min(pos,neg)/prob->l);
 			tron_obj.set_print_string(liblinear_print_string);
 			tron_obj.tron(w);
@@ -1906,6 +2149,7 @@ model* train(const problem *prob, const parameter *param)
 	else
 		model_->nr_feature=n;
 	model_->param = *param;
+	model_->param.init_sol = NULL;
 	model_->bias = prob->bias;
 
 	int nr_class;
@@ -1967,6 +2211,8 @@ model* train(const problem *prob, const parameter *param)
 		if(nr_class == 2)
 		{
 			model_->w=Malloc(double, w_size);
+			for(i=0;i<w_size;i++)
+				model_->w[i] = (param->init_sol != NULL) ? param->init_sol[i] : 0;
 
 			int e0 = start[0]+count[0];
 			k=0;
@@ -1994,6 +2240,9 @@ model* train(const problem *prob, const parameter *param)
 				for(; k<sub_prob.l; k++)
 					sub_prob.y[k] = -1;
 
+				for(int j=0;j<w_size;j++)
+					w[j] = (param->init_sol != NULL) ? param->init_sol[j*nr_class+i] : 0;
+
 				train_one(&sub_prob, param, w, weighted_C[i], param->C);
 
 				for(int j=0;j<w_size;j++)
@@ -2352,6 +2601,9 @@ const char *check_parameter(const problem *prob, const parameter *param)
 	if(param->C <= 0)
 		return "C <= 0";
 
+	if(param->nr_thread < 1)
+		return "nr_thread < 1";
+
 	if(param->solver_type != L2R_LR
 		&& param->solver_type != L2R_L2LOSS_SVC_DUAL
 		&& param->solver_type != L2R_L2LOSS_SVC
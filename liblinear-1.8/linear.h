@@ -31,6 +31,8 @@ struct parameter
 	int nr_weight;
 	int *weight_label;
 	double* weight;
+	int nr_thread;		/* threads for the L2R_LR objective, gradient and Hv */
+	double *init_sol;	/* initial w for L2R_LR and L2R_L2LOSS_SVC, NULL for zero */
 };
 
 struct model
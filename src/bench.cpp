@@ -0,0 +1,410 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
+#include "sentence.hpp"
+#include "modality.hpp"
+#include "bench_corpus.hpp"
+
+
+double elapsed_ms(const boost::posix_time::ptime &st) {
+	return (boost::posix_time::microsec_clock::universal_time() - st).total_microseconds() / 1000.0;
+}
+
+
+// nearest-rank percentile of sorted values
+double percentile(const std::vector<double> &sorted, double p) {
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+	if (rank == 0) {
+		rank = 1;
+	}
+	return sorted[rank-1];
+}
+
+
+std::string layer_name(int input_layer) {
+	switch (input_layer) {
+		case modality::IN_RAW:
+			return "raw text through CaboCha";
+		case modality::IN_DEP_CAB:
+			return "CaboCha format";
+		case modality::IN_DEP_KNP:
+			return "KNP format";
+		case modality::IN_PAS_SYN:
+			return "SynCha format";
+		case modality::IN_PAS_KNP:
+			return "KNP PAS format";
+	}
+	return "unknown";
+}
+
+
+// raw text is one sentence per line, the others are terminated by EOS
+void read_corpus(const std::string &path, int input_layer, std::vector< std::string > &sents) {
+	std::ifstream ifs(path.c_str());
+	if (!ifs) {
+		std::cerr << "ERROR: cannot open " << path << std::endl;
+		exit(-1);
+	}
+	std::string buf, sent;
+	while (getline(ifs, buf)) {
+		if (input_layer == modality::IN_RAW) {
+			sents.push_back(buf);
+		}
+		else if (buf.compare(0, 3, "EOS") == 0) {
+			sents.push_back(sent + buf);
+			sent.clear();
+		}
+		else {
+			sent += buf + "\n";
+		}
+	}
+}
+
+
+/*
+ * analyze the warm-up sentences without measuring, then every sentence with
+ * its own timer
+ */
+void run_bench(modality::parser &mod_parser, int input_layer, const std::vector< std::string > &sents, unsigned int warmup) {
+	for (unsigned int i=0 ; i<warmup ; ++i) {
+		nlp::sentence sent;
+		mod_parser.analyze(sents[i % sents.size()], input_layer, sent);
+	}
+
+	std::vector<double> latencies;
+	unsigned long cnt_tok = 0;
+	unsigned long cnt_target = 0;
+	boost::posix_time::ptime st_all = boost::posix_time::microsec_clock::universal_time();
+	BOOST_FOREACH (const std::string &str, sents) {
+		boost::posix_time::ptime st = boost::posix_time::microsec_clock::universal_time();
+		nlp::sentence sent;
+		mod_parser.analyze(str, input_layer, sent);
+		latencies.push_back(elapsed_ms(st));
+
+		BOOST_FOREACH (const nlp::chunk &chk, sent.chunks) {
+			BOOST_FOREACH (const nlp::token &tok, chk.tokens) {
+				cnt_tok++;
+				if (tok.has_mod) {
+					cnt_target++;
+				}
+			}
+		}
+	}
+	double sec = elapsed_ms(st_all) / 1000.0;
+	sort(latencies.begin(), latencies.end());
+
+	std::cout << "layer " << input_layer << " (" << layer_name(input_layer) << "): " << sents.size() << " sents, " << cnt_tok << " tokens, " << cnt_target << " targets" << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "  time:       " << sec << " sec (" << warmup << " warm-up sents)" << std::endl;
+	if (sec > 0) {
+		std::cout << std::setprecision(1);
+		std::cout << "  throughput: " << sents.size() / sec << " sents/sec, " << cnt_tok / sec << " tokens/sec, " << cnt_target / sec << " targets/sec" << std::endl;
+	}
+	std::cout << std::setprecision(3);
+	std::cout << "  latency:    p50 " << percentile(latencies, 50) << " ms, p95 " << percentile(latencies, 95) << " ms, p99 " << percentile(latencies, 99) << " ms" << std::endl;
+	std::cout.unsetf(std::ios::fixed);
+}
+
+
+/*
+ * predictions of the events of one run of the corpus, tag by tag in the order
+ * of analysis, and how many of those of the gold events are correct
+ */
+typedef struct {
+	double sec;
+	unsigned long full;
+	unsigned long gold;
+	unsigned long correct;
+	std::vector< std::string > labels;
+} t_cascade_run;
+
+
+void run_cascade_once(modality::parser &mod_parser, int input_layer, const std::vector< std::string > &sents, const std::vector< std::vector< nlp::modality > > &golds, t_cascade_run &run) {
+	unsigned long full = mod_parser.cascade_preds[1];
+	run.gold = 0;
+	run.correct = 0;
+	run.labels.clear();
+	run.sec = 0;
+	for (size_t s=0 ; s<sents.size() ; ++s) {
+		boost::posix_time::ptime st = boost::posix_time::microsec_clock::universal_time();
+		nlp::sentence sent;
+		mod_parser.analyze(sents[s], input_layer, sent);
+		run.sec += elapsed_ms(st) / 1000.0;
+
+		BOOST_FOREACH (nlp::chunk &chk, sent.chunks) {
+			BOOST_FOREACH (nlp::token &tok, chk.tokens) {
+				if (!tok.has_mod) {
+					continue;
+				}
+				const nlp::modality *gold = NULL;
+				BOOST_FOREACH (const nlp::modality &mod, golds[s]) {
+					if (find(mod.tids.begin(), mod.tids.end(), tok.id) != mod.tids.end()) {
+						gold = &mod;
+					}
+				}
+				BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
+					run.labels.push_back(tok.mod.get(i));
+					if (gold != NULL) {
+						run.gold++;
+						if (gold->tag[i] == tok.mod.tag[i]) {
+							run.correct++;
+						}
+					}
+				}
+			}
+		}
+	}
+	run.full = mod_parser.cascade_preds[1] - full;
+}
+
+
+/*
+ * accuracy and speed of the cascade at each margin: the corpus is analyzed by
+ * the full models, then by the cascade at each margin, whose predictions are
+ * compared with those of the full models and with the gold tags of the
+ * #EVENT lines of the corpus, if any
+ */
+void run_cascade(modality::parser &mod_parser, int input_layer, const std::vector< std::string > &corpus, const std::vector<double> &margins, unsigned int warmup) {
+	// gold events are taken out of the input not to be analyzed as such
+	std::vector< std::string > sents;
+	std::vector< std::vector< nlp::modality > > golds(corpus.size());
+	for (size_t s=0 ; s<corpus.size() ; ++s) {
+		if (input_layer == modality::IN_RAW) {
+			sents.push_back(corpus[s]);
+			continue;
+		}
+		std::vector< std::string > lines, rest;
+		boost::algorithm::split(lines, corpus[s], boost::algorithm::is_any_of("\n"));
+		BOOST_FOREACH (const std::string &l, lines) {
+			if (l.compare(0, 6, "#EVENT") == 0) {
+				nlp::modality mod;
+				mod.parse(l);
+				golds[s].push_back(mod);
+			}
+			else {
+				rest.push_back(l);
+			}
+		}
+		sents.push_back(boost::algorithm::join(rest, "\n"));
+	}
+
+	for (unsigned int i=0 ; i<warmup ; ++i) {
+		nlp::sentence sent;
+		mod_parser.analyze(sents[i % sents.size()], input_layer, sent);
+	}
+
+	t_cascade_run ref;
+	mod_parser.cascade = false;
+	run_cascade_once(mod_parser, input_layer, sents, golds, ref);
+	mod_parser.cascade = true;
+
+	std::cout << "layer " << input_layer << " (" << layer_name(input_layer) << "): " << sents.size() << " sents, " << ref.labels.size() << " predictions, " << ref.gold << " of them of gold events" << std::endl;
+	std::cout << boost::format("  %-8s %10s %12s %8s %10s %9s") % "margin" % "time (s)" % "sents/sec" % "full" % "agreement" % "accuracy" << std::endl;
+	for (size_t m=0 ; m<=margins.size() ; ++m) {
+		t_cascade_run run;
+		std::string margin = "full";
+		if (m < margins.size()) {
+			mod_parser.cascade_threshold = margins[m];
+			run_cascade_once(mod_parser, input_layer, sents, golds, run);
+			margin = (boost::format("%g") % margins[m]).str();
+		}
+		else {
+			run = ref;
+			run.full = run.labels.size();
+		}
+
+		unsigned long agree = 0;
+		for (size_t k=0 ; k<run.labels.size() && k<ref.labels.size() ; ++k) {
+			agree += (run.labels[k] == ref.labels[k]);
+		}
+		std::string acc = "-";
+		if (run.gold > 0) {
+			acc = (boost::format("%.2f%%") % (100.0 * run.correct / run.gold)).str();
+		}
+		double n = run.labels.size() ? run.labels.size() : 1;
+		std::cout << boost::format("  %-8s %10.3f %12.1f %7.1f%% %9.2f%% %9s") % margin % run.sec % (run.sec > 0 ? sents.size() / run.sec : 0.0) % (100.0 * run.full / n) % (100.0 * agree / n) % acc << std::endl;
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	boost::program_options::options_description opt("Usage", 200, 100);
+	opt.add_options()
+		("layers,l", boost::program_options::value<std::string>()->default_value("0,1"), "comma-separated input layers to replay the synthetic corpus through\n 0 - raw text layer through CaboCha\n 1 - dependency parsed layer by CaboCha/J.DepP")
+		("corpus,c", boost::program_options::value<std::string>(), "replay this corpus instead of a synthetic one (optional); its layer is given by --input")
+		("input,i", boost::program_options::value<int>(), "input layer of --corpus\n 0 - raw text layer\n 1 - dependency parsed layer by CaboCha/J.DepP\n 2 - dependency parsed layer by KNP\n 3 - predicate-argument structure analyzed layer by SynCha/ChaPAS\n 4 - predicate-argument structure analyzed layer by KNP")
+		("fixtures", boost::program_options::value<std::string>()->default_value("test"), "directory of the fixtures the synthetic corpus is made from")
+		("sents,n", boost::program_options::value<unsigned int>()->default_value(1000), "number of synthetic sentences")
+		("seed", boost::program_options::value<unsigned int>()->default_value(1), "seed of the synthetic corpus")
+		("warmup", boost::program_options::value<unsigned int>()->default_value(100), "number of sentences analyzed before measuring")
+		("dump", boost::program_options::value<std::string>(), "write the synthetic corpus to this directory (optional)")
+		("pos", boost::program_options::value<int>(), "POS tag for CaboCha/J.DepP (optional)\n 0 - IPA/Naist-jdic [default]\n 1 - JumanDic\n 2 - UniDic")
+		("posset", boost::program_options::value<std::string>(), "POS set to parse (optional")
+		("target,t", boost::program_options::value<unsigned int>(), "method of detecting token to be analyzed\n 0 - by part of speech [default]\n 1 - predicate detected by a predicate-argument structure analyzer (only SynCha format is supported)\n 2 - by machine learning: the tokens detected by part of speech that the target detector of the model (model_target) takes for events")
+		("target-threshold", boost::program_options::value<double>(), "probability of being an event from which a token is a target with --target 2 (optional): default 0.5")
+		("cascade", boost::program_options::value<std::string>(), "report the time, the rate of predictions left to the full models, the agreement with the full models and the accuracy on the #EVENT lines of --corpus of the cascade at these comma-separated margins, instead of the benchmark (optional); the model needs the fast models of zunda-train --cascade")
+		("model,m", boost::program_options::value<std::string>(), "model directory (optional)")
+		("dic,d", boost::program_options::value<std::string>(), "dictionary directory (optional)")
+		("help,h", "Show help messages")
+		("version,v", "Show version information");
+
+	boost::program_options::variables_map argmap;
+	boost::program_options::store(parse_command_line(argc, argv, opt), argmap);
+	boost::program_options::notify(argmap);
+
+	if (argmap.count("help")) {
+		std::cout << opt << std::endl;
+		return 1;
+	}
+
+	if (argmap.count("version")) {
+		std::cout << PACKAGE_VERSION << std::endl;
+		return 1;
+	}
+
+	int pos_tag = modality::POS_IPA;
+	if (argmap.count("pos")) {
+		pos_tag = argmap["pos"].as<int>();
+	}
+
+	std::string pos_set;
+	if (argmap.count("posset")) {
+		pos_set = argmap["posset"].as<std::string>();
+	}
+
+	std::string model_dir;
+	switch (pos_tag) {
+		case modality::POS_IPA:
+			model_dir = MODELDIR_IPA;
+			break;
+		case modality::POS_JUMAN:
+			model_dir = MODELDIR_JUMAN;
+			break;
+		default:
+			std::cerr << "ERROR: no such pos tag" << std::endl;
+			return -1;
+	}
+	if (argmap.count("model")) {
+		model_dir = argmap["model"].as<std::string>();
+	}
+
+	std::string dic_dir = DICDIR;
+	if (argmap.count("dic")) {
+		dic_dir = argmap["dic"].as<std::string>();
+	}
+
+	std::vector<int> layers;
+	if (argmap.count("corpus")) {
+		if (!argmap.count("input")) {
+			std::cerr << "ERROR: --corpus needs --input" << std::endl;
+			exit(-1);
+		}
+		layers.push_back(argmap["input"].as<int>());
+	}
+	else {
+		std::vector<std::string> vals;
+		boost::algorithm::split(vals, argmap["layers"].as<std::string>(), boost::algorithm::is_any_of(","));
+		BOOST_FOREACH (const std::string &val, vals) {
+			int layer = atoi(val.c_str());
+			// the fixtures are CaboCha format with IPA POS tags
+			if (layer != modality::IN_RAW && layer != modality::IN_DEP_CAB) {
+				std::cerr << "ERROR: the synthetic corpus is raw text or CaboCha format; give other layers by --corpus" << std::endl;
+				exit(-1);
+			}
+			layers.push_back(layer);
+		}
+	}
+	BOOST_FOREACH (int layer, layers) {
+		if (layer < modality::IN_RAW || layer > modality::IN_PAS_KNP) {
+			std::cerr << "ERROR: invalid input layer" << std::endl;
+			exit(-1);
+		}
+	}
+
+	modality::parser mod_parser(model_dir, dic_dir);
+	if (!mod_parser.set_pos_tag(pos_tag, pos_set)) {
+		exit(-1);
+	}
+	if (argmap.count("target")) {
+		mod_parser.target_detection = argmap["target"].as<unsigned int>();
+	}
+	if (argmap.count("target-threshold")) {
+		mod_parser.target_threshold = argmap["target-threshold"].as<double>();
+	}
+	std::vector<double> margins;
+	if (argmap.count("cascade")) {
+		std::vector<std::string> vals;
+		boost::algorithm::split(vals, argmap["cascade"].as<std::string>(), boost::algorithm::is_any_of(","));
+		BOOST_FOREACH (const std::string &val, vals) {
+			margins.push_back(atof(val.c_str()));
+			if (margins.back() < 0) {
+				std::cerr << "ERROR: invalid cascade margin: " << val << std::endl;
+				exit(-1);
+			}
+		}
+		mod_parser.cascade = true;
+	}
+
+	boost::posix_time::ptime st = boost::posix_time::microsec_clock::universal_time();
+	if (!mod_parser.load_models()) {
+		std::cerr << "ERROR: load models failed" << std::endl;
+		return false;
+	}
+	std::cout << "model load: " << std::fixed << std::setprecision(3) << elapsed_ms(st) << " ms" << std::endl;
+	std::cout.unsetf(std::ios::fixed);
+
+	std::vector< std::string > corpus[modality::IN_NUM];
+	if (argmap.count("corpus")) {
+		read_corpus(argmap["corpus"].as<std::string>(), layers[0], corpus[layers[0]]);
+		std::cout << "corpus: " << argmap["corpus"].as<std::string>() << std::endl;
+	}
+	else {
+		modality::bench_corpus generator;
+		if (!generator.load_fixtures(argmap["fixtures"].as<std::string>(), mod_parser)) {
+			std::cerr << "ERROR: no sentences in the fixtures" << std::endl;
+			exit(-1);
+		}
+		unsigned int seed = argmap["seed"].as<unsigned int>();
+		generator.generate(argmap["sents"].as<unsigned int>(), seed, corpus[modality::IN_RAW], corpus[modality::IN_DEP_CAB]);
+		std::cout << "corpus: " << corpus[modality::IN_RAW].size() << " synthetic sents from " << generator.size() << " fixture sents (seed " << seed << ")" << std::endl;
+
+		if (argmap.count("dump")) {
+			boost::filesystem::path dump_dir(argmap["dump"].as<std::string>());
+			boost::filesystem::create_directories(dump_dir);
+			std::ofstream ofs_raw((dump_dir / "bench.txt").string().c_str());
+			BOOST_FOREACH (const std::string &s, corpus[modality::IN_RAW]) {
+				ofs_raw << s << std::endl;
+			}
+			std::ofstream ofs_cab((dump_dir / "bench.cab").string().c_str());
+			BOOST_FOREACH (const std::string &s, corpus[modality::IN_DEP_CAB]) {
+				ofs_cab << s << std::endl;
+			}
+		}
+	}
+
+	BOOST_FOREACH (int layer, layers) {
+		if (corpus[layer].empty()) {
+			std::cerr << "ERROR: no sentences for layer " << layer << std::endl;
+			exit(-1);
+		}
+		if (mod_parser.cascade) {
+			run_cascade(mod_parser, layer, corpus[layer], margins, argmap["warmup"].as<unsigned int>());
+		}
+		else {
+			run_bench(mod_parser, layer, corpus[layer], argmap["warmup"].as<unsigned int>());
+		}
+	}
+
+	return 1;
+}
@@ -0,0 +1,232 @@
+#ifndef __BENCH_CORPUS_HPP__
+#define __BENCH_CORPUS_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/random.hpp>
+#include "modality.hpp"
+
+namespace modality {
+	/*
+	 * Synthetic corpus for benchmarks, made from the fixtures under test/.
+	 * Sentences of the fixtures are read as CaboCha format (IPA POS tag):
+	 *   *.cab    - CaboCha -f1 format
+	 *   *.deppas - SynCha format, converted to -f1 without the PAS column
+	 *   *.xml    - BCCWJ-style XML, parsed by the CaboCha of the parser
+	 * A generated sentence joins a prefix of one sentence to a suffix of
+	 * another at chunk boundaries, with the dependencies renumbered, and is
+	 * written both as raw text and as CaboCha format. The sentences depend
+	 * only on the fixtures and the seed.
+	 */
+	class bench_corpus {
+		private:
+			typedef struct {
+				int dst;
+				// header after the dependency, e.g. " 1/2 1.051780"
+				std::string rest;
+				std::vector< std::string > tokens;
+			} t_chunk;
+			typedef std::vector< t_chunk > t_sent;
+
+			std::vector< t_sent > sources;
+
+		public:
+			size_t size() const {
+				return sources.size();
+			}
+
+			bool load_fixtures(const std::string &dir, parser &mod_parser) {
+				boost::filesystem::path dir_path(dir);
+				if (!boost::filesystem::is_directory(dir_path)) {
+					std::cerr << "ERROR: no fixture directory " << dir << std::endl;
+					return false;
+				}
+				std::vector< std::string > files;
+				boost::filesystem::directory_iterator end;
+				for (boost::filesystem::directory_iterator it(dir_path) ; it!=end ; ++it) {
+					files.push_back(it->path().string());
+				}
+				// directory order is not fixed
+				sort(files.begin(), files.end());
+
+				BOOST_FOREACH (const std::string &file, files) {
+					boost::filesystem::path p(file);
+					if (p.extension() == ".cab" || p.extension() == ".deppas") {
+						load_cabocha(file);
+					}
+					else if (p.extension() == ".xml") {
+						load_xml(file, mod_parser);
+					}
+				}
+				return !sources.empty();
+			}
+
+			/*
+			 * n sentences as raw text (one per line) and as CaboCha format, each
+			 * joined from parts sentences: a prefix of the first one and a suffix
+			 * of each of the others
+			 */
+			void generate(unsigned int n, unsigned int seed, std::vector< std::string > &raws, std::vector< std::string > &cabs, unsigned int parts=2) const {
+				boost::mt19937 gen(seed);
+				raws.clear();
+				cabs.clear();
+				std::vector< const t_sent* > picked(parts < 1 ? 1 : parts);
+				for (unsigned int i=0 ; i<n ; ++i) {
+					for (size_t k=0 ; k<picked.size() ; ++k) {
+						picked[k] = &sources[rand_int(gen, sources.size())];
+					}
+					// a[0, cut_a)
+					const t_sent &a = *picked[0];
+					size_t cut_a = 1 + rand_int(gen, a.size());
+					t_sent sent(a.begin(), a.begin() + cut_a);
+					BOOST_FOREACH (t_chunk &chk, sent) {
+						if (chk.dst >= (int)cut_a) {
+							chk.dst = -1;
+						}
+					}
+
+					// + b[cut_b, b.size()) for the others
+					for (size_t k=1 ; k<picked.size() ; ++k) {
+						const t_sent &b = *picked[k];
+						size_t cut_b = rand_int(gen, b.size());
+						size_t offset = sent.size();
+						// the chunks without a head so far depend on the new part
+						BOOST_FOREACH (t_chunk &chk, sent) {
+							if (chk.dst < 0) {
+								chk.dst = offset;
+							}
+						}
+						for (size_t j=cut_b ; j<b.size() ; ++j) {
+							t_chunk chk = b[j];
+							if (chk.dst >= 0) {
+								chk.dst = chk.dst - cut_b + offset;
+							}
+							sent.push_back(chk);
+						}
+					}
+					// the last chunk is the root
+					for (size_t j=0 ; j+1<sent.size() ; ++j) {
+						if (sent[j].dst < 0) {
+							sent[j].dst = sent.size() - 1;
+						}
+					}
+					sent.back().dst = -1;
+
+					std::string raw, cab;
+					to_string(sent, raw, cab);
+					raws.push_back(raw);
+					cabs.push_back(cab);
+				}
+			}
+
+		private:
+			static size_t rand_int(boost::mt19937 &gen, size_t n) {
+				boost::uniform_int<size_t> dist(0, n-1);
+				return dist(gen);
+			}
+
+			static void to_string(const t_sent &sent, std::string &raw, std::string &cab) {
+				std::stringstream ss;
+				raw.clear();
+				for (size_t i=0 ; i<sent.size() ; ++i) {
+					ss << "* " << i << " " << sent[i].dst << "D" << sent[i].rest << "\n";
+					BOOST_FOREACH (const std::string &tok, sent[i].tokens) {
+						ss << tok << "\n";
+						raw += tok.substr(0, tok.find('\t'));
+					}
+				}
+				ss << "EOS";
+				cab = ss.str();
+			}
+
+			// SynCha token line to CaboCha -f1 without the PAS column
+			static std::string to_f1(const std::string &line) {
+				std::vector< std::string > cols;
+				boost::algorithm::split(cols, line, boost::algorithm::is_any_of("\t"));
+				if (cols.size() < 7 || cols[1].find(',') != std::string::npos) {
+					// already -f1
+					return line;
+				}
+				std::vector< std::string > pos;
+				boost::algorithm::split(pos, cols[3], boost::algorithm::is_any_of("-"));
+				pos.resize(4);
+				std::stringstream ss;
+				ss << cols[0] << "\t";
+				BOOST_FOREACH (std::string &p, pos) {
+					ss << (p.empty() ? "*" : p) << ",";
+				}
+				ss << (cols[4].empty() ? "*" : cols[4]) << ",";
+				ss << (cols[5].empty() ? "*" : cols[5]) << ",";
+				ss << cols[2] << "," << cols[1] << "," << cols[1] << "\t" << cols[6];
+				return ss.str();
+			}
+
+			void add_lines(const std::vector< std::string > &lines) {
+				t_sent sent;
+				BOOST_FOREACH (const std::string &line, lines) {
+					if (line.compare(0, 3, "EOS") == 0) {
+						if (!sent.empty()) {
+							sources.push_back(sent);
+						}
+						sent.clear();
+					}
+					else if (line.compare(0, 2, "* ") == 0) {
+						t_chunk chk;
+						int id;
+						if (sscanf(line.c_str(), "* %d %d", &id, &chk.dst) != 2) {
+							continue;
+						}
+						size_t p = line.find('D', 2);
+						chk.rest = (p == std::string::npos) ? "" : line.substr(p+1);
+						sent.push_back(chk);
+					}
+					else if (!line.empty() && line[0] != '#' && !sent.empty()) {
+						sent.back().tokens.push_back(to_f1(line));
+					}
+				}
+			}
+
+			void load_cabocha(const std::string &file) {
+				std::ifstream ifs(file.c_str());
+				std::string buf;
+				std::vector< std::string > lines;
+				while (getline(ifs, buf)) {
+					boost::algorithm::trim_right_if(buf, boost::algorithm::is_any_of("\r"));
+					lines.push_back(buf);
+				}
+				add_lines(lines);
+			}
+
+			void load_xml(const std::string &file, parser &mod_parser) {
+				boost::filesystem::path p(file);
+				// OC (Yahoo! Chiebukuro) is written with webLine tags
+				std::vector< std::vector< t_token > > sents;
+				if (boost::filesystem::path(p.filename()).string().compare(0, 2, "OC") == 0) {
+					sents = mod_parser.parse_OC(file);
+				}
+				else {
+					sents = mod_parser.parse_OW_PB_PN(file);
+				}
+				BOOST_FOREACH (const std::vector< t_token > &toks, sents) {
+					std::string raw;
+					BOOST_FOREACH (const t_token &tok, toks) {
+						raw += tok.orthToken;
+					}
+					std::vector< std::string > lines;
+					std::string parsed = mod_parser.cabocha->parseToString(raw.c_str());
+					boost::algorithm::split(lines, parsed, boost::algorithm::is_any_of("\n"));
+					add_lines(lines);
+				}
+			}
+	};
+};
+
+#endif
@@ -7,19 +7,27 @@
 #include <sstream>
 #include <boost/unordered_map.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
 #include "../cdbpp-1.1/include/cdbpp.h"
+#include "stats.hpp"
 
 template <typename K, typename V>
 class CdbMap {
 	private:
 		cdbpp::cdbpp dbr;
+		// the memo map is guarded when shared by threads (set_concurrent)
+		bool concurrent;
+		boost::shared_mutex mtx;
 	public:
 		boost::unordered_map<K, V> map;
 	public:
 		CdbMap(const char *cdb_path) {
+			concurrent = false;
 			open_cdb(cdb_path);
 		}
 		CdbMap() {
+			concurrent = false;
 		}
 		~CdbMap() {
 		}
@@ -44,34 +52,41 @@ class CdbMap {
 			return false;
 		}
 
+		void set_concurrent(bool _concurrent) {
+			concurrent = _concurrent;
+		}
+
 		bool get(const K key, V *val) {
+			if (concurrent) {
+				return get_concurrent(key, val);
+			}
+
 			if (map.find(key) != map.end()) {
 				*val = map[key];
 				return true;
 			}
-			
-			if (!dbr.is_open()) {
-				return false;
-			}
 
-			size_t vsize;
-			std::stringstream key_ss;
-			key_ss << key;
-			const char *value = (const char *)dbr.get(key_ss.str().c_str(), key_ss.str().length(), &vsize);
-			if (value == NULL) {
+			if (!get_cdb(key, val)) {
 				return false;
 			}
-			else {
-				std::string val_str = std::string(value, vsize);
-				*val = boost::lexical_cast<V>(val_str);
-				map[key] = *val;
-				return true;
-			}
+			map[key] = *val;
+			return true;
 		}
 		
 		size_t size() {
 			return map.size();
 		}
+
+		// estimated heap bytes of the memo map: nodes, buckets and strings
+		size_t memo_bytes() {
+			size_t bytes = map.bucket_count() * sizeof(void *);
+			typename boost::unordered_map<K, V>::iterator it_map;
+			for (it_map=map.begin() ; it_map!=map.end() ; ++it_map) {
+				bytes += sizeof(typename boost::unordered_map<K, V>::value_type) + 2 * sizeof(void *);
+				bytes += heap_bytes(it_map->first) + heap_bytes(it_map->second);
+			}
+			return bytes;
+		}
 		
 		void dump_map() {
 			typename boost::unordered_map<K, V>::iterator it_map;
@@ -79,6 +94,51 @@ class CdbMap {
 				std::cout << it_map->first << "\t" << it_map->second << std::endl;
 			}
 		}
+
+	private:
+		bool get_cdb(const K &key, V *val) {
+			if (!dbr.is_open()) {
+				return false;
+			}
+
+			size_t vsize;
+			std::stringstream key_ss;
+			key_ss << key;
+			modality::stats::count(modality::SC_CDB_LOOKUPS);
+			const char *value = (const char *)dbr.get(key_ss.str().c_str(), key_ss.str().length(), &vsize);
+			if (value == NULL) {
+				return false;
+			}
+			std::string val_str = std::string(value, vsize);
+			*val = boost::lexical_cast<V>(val_str);
+			return true;
+		}
+
+		// readers share the memo map, a miss is looked up without the lock
+		bool get_concurrent(const K &key, V *val) {
+			{
+				boost::shared_lock<boost::shared_mutex> lock(mtx);
+				typename boost::unordered_map<K, V>::const_iterator it_map = map.find(key);
+				if (it_map != map.end()) {
+					*val = it_map->second;
+					return true;
+				}
+			}
+			if (!get_cdb(key, val)) {
+				return false;
+			}
+			boost::unique_lock<boost::shared_mutex> lock(mtx);
+			map[key] = *val;
+			return true;
+		}
+
+		static size_t heap_bytes(const std::string &s) {
+			return s.capacity();
+		}
+
+		template <typename T> static size_t heap_bytes(const T &) {
+			return 0;
+		}
 };
 
 #endif
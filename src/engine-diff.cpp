@@ -0,0 +1,421 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <set>
+#include <algorithm>
+#include <cmath>
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include "sentence.hpp"
+#include "modality.hpp"
+#include "bench_corpus.hpp"
+
+
+/*
+ * Engines compared with the reference path. An engine is the parser set up
+ * in its own way before its models are loaded; the reference is
+ * parser::analyze as it is. Only the tags the engine analyzes are compared,
+ * so an engine may narrow analyze_tags.
+ */
+typedef struct {
+	const char *name;
+	const char *desc;
+	bool (*setup)(modality::parser &);
+} t_engine;
+
+
+bool setup_reference(modality::parser &) {
+	return true;
+}
+
+
+// --tags authenticity: tense and type are analyzed for its features, the
+// other tags are left as they are
+bool setup_tags(modality::parser &mod_parser) {
+	return mod_parser.set_analyze_tags("authenticity");
+}
+
+
+// the POS sets compared as strings rather than by pos_matcher
+bool setup_pos_strings(modality::parser &mod_parser) {
+	mod_parser.match_pos_strings = true;
+	return true;
+}
+
+
+// every target makes the strings of the chunks itself
+bool setup_no_chunk_cache(modality::parser &mod_parser) {
+	mod_parser.use_chunk_cache = false;
+	return true;
+}
+
+
+const t_engine engines[] = {
+	{"reference", "parser::analyze as it is (checks the harness itself)", &setup_reference},
+	{"tags", "--tags authenticity, compared on authenticity, tense and type", &setup_tags},
+	{"pos-strings", "target POS sets compared as strings", &setup_pos_strings},
+	{"no-chunk-cache", "features made without the strings of chunk_cache", &setup_no_chunk_cache}
+};
+const unsigned int engine_num = sizeof(engines) / sizeof(engines[0]);
+
+
+const t_engine *find_engine(const std::string &name) {
+	for (unsigned int i=0 ; i<engine_num ; ++i) {
+		if (name == engines[i].name) {
+			return &engines[i];
+		}
+	}
+	return NULL;
+}
+
+
+// raw text is one sentence per line, the others are terminated by EOS
+void read_corpus(const std::string &path, int input_layer, std::vector< std::string > &sents) {
+	std::ifstream ifs(path.c_str());
+	if (!ifs) {
+		std::cerr << "ERROR: cannot open " << path << std::endl;
+		exit(-1);
+	}
+	std::string buf, sent;
+	while (getline(ifs, buf)) {
+		if (input_layer == modality::IN_RAW) {
+			sents.push_back(buf);
+		}
+		else if (buf.compare(0, 3, "EOS") == 0) {
+			sents.push_back(sent + buf);
+			sent.clear();
+		}
+		else {
+			sent += buf + "\n";
+		}
+	}
+}
+
+
+/*
+ * tags without a model file are not analyzed by either side; the models of
+ * some tags are not bundled
+ */
+void drop_missing_tags(modality::parser &mod_parser, bool verbose) {
+	std::vector<unsigned int> tags;
+	BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
+		if (boost::filesystem::exists(mod_parser.model_path[i])) {
+			tags.push_back(i);
+		}
+		else if (verbose) {
+			std::cerr << "WARN: " << mod_parser.model_path[i].string() << " not found, " << mod_parser.id2tag(i) << " is not compared" << std::endl;
+		}
+	}
+	mod_parser.analyze_tags = tags;
+}
+
+
+/*
+ * #EVENT lines with the columns of the tags not in tags (those of the
+ * reference that the engine does not analyze) replaced by "*"; the columns
+ * are the event, its token ids and the tags in nlp::MOD_* order
+ */
+void event_lines(const std::string &parsed, const std::vector<unsigned int> &tags, std::vector< std::string > &events) {
+	bool compared[nlp::MOD_TAG_NUM];
+	for (unsigned int t=0 ; t<nlp::MOD_TAG_NUM ; ++t) {
+		// source and focus are not analyzed by models
+		compared[t] = (t == nlp::MOD_SOURCE || t == nlp::MOD_FOCUS);
+	}
+	BOOST_FOREACH (unsigned int t, tags) {
+		compared[t] = true;
+	}
+
+	std::vector< std::string > lines;
+	boost::algorithm::split(lines, parsed, boost::algorithm::is_any_of("\n"));
+	events.clear();
+	BOOST_FOREACH (const std::string &line, lines) {
+		if (line.compare(0, 6, "#EVENT") != 0) {
+			continue;
+		}
+		std::vector< std::string > cols;
+		boost::algorithm::split(cols, line, boost::algorithm::is_any_of("\t"));
+		for (unsigned int t=0 ; t<nlp::MOD_TAG_NUM && t+2<cols.size() ; ++t) {
+			if (!compared[t]) {
+				cols[t+2] = "*";
+			}
+		}
+		events.push_back(boost::algorithm::join(cols, "\t"));
+	}
+}
+
+
+// decisions of the given tags only
+void select_decisions(std::vector< modality::t_decision > &decisions, const std::vector<unsigned int> &tags) {
+	std::vector< modality::t_decision > selected;
+	BOOST_FOREACH (const modality::t_decision &d, decisions) {
+		if (std::find(tags.begin(), tags.end(), d.tag) != tags.end()) {
+			selected.push_back(d);
+		}
+	}
+	decisions.swap(selected);
+}
+
+
+// features of one side only, as "-feat" (reference) and "+feat" (engine)
+void feature_diff(const std::string &ref_str, const std::string &eng_str, std::ostream &os) {
+	std::vector< std::string > ref_vec, eng_vec;
+	boost::algorithm::split(ref_vec, ref_str, boost::algorithm::is_any_of(" "), boost::algorithm::token_compress_on);
+	boost::algorithm::split(eng_vec, eng_str, boost::algorithm::is_any_of(" "), boost::algorithm::token_compress_on);
+	std::set< std::string > ref_feats(ref_vec.begin(), ref_vec.end());
+	std::set< std::string > eng_feats(eng_vec.begin(), eng_vec.end());
+	ref_feats.erase("");
+	eng_feats.erase("");
+	unsigned int n_diff = 0;
+	BOOST_FOREACH (const std::string &f, ref_feats) {
+		if (eng_feats.find(f) == eng_feats.end()) {
+			os << "      -" << f << std::endl;
+			n_diff++;
+		}
+	}
+	BOOST_FOREACH (const std::string &f, eng_feats) {
+		if (ref_feats.find(f) == ref_feats.end()) {
+			os << "      +" << f << std::endl;
+			n_diff++;
+		}
+	}
+	if (n_diff == 0) {
+		os << "      (same features)" << std::endl;
+	}
+}
+
+
+void print_decision(modality::parser &mod_parser, const char *side, const modality::t_decision &d, std::ostream &os) {
+	std::streamsize prec = os.precision();
+	os << "    " << side << ": token " << d.tok_id << " " << mod_parser.id2tag(d.tag) << " -> " << d.label << " (" << std::setprecision(12);
+	for (size_t v=0 ; v<d.values.size() ; ++v) {
+		os << (v ? " " : "") << d.values[v];
+	}
+	os << ")" << std::endl;
+	os.precision(prec);
+}
+
+
+/*
+ * first difference of the decisions of a sentence, or -1; decisions are
+ * the same when they are made for the same token and tag with the same
+ * label and their decision values are within the tolerance
+ */
+long first_divergent(const std::vector< modality::t_decision > &ref, const std::vector< modality::t_decision > &eng, double tolerance) {
+	size_t n = std::min(ref.size(), eng.size());
+	for (size_t i=0 ; i<n ; ++i) {
+		if (ref[i].tok_id != eng[i].tok_id || ref[i].tag != eng[i].tag || ref[i].label != eng[i].label || ref[i].values.size() != eng[i].values.size()) {
+			return i;
+		}
+		for (size_t v=0 ; v<ref[i].values.size() ; ++v) {
+			if (std::fabs(ref[i].values[v] - eng[i].values[v]) > tolerance) {
+				return i;
+			}
+		}
+	}
+	return (ref.size() == eng.size()) ? -1 : (long)n;
+}
+
+
+/*
+ * analyze every sentence by both parsers and report the first divergent
+ * one; returns false if there is one
+ */
+bool compare(modality::parser &ref_parser, modality::parser &eng_parser, int input_layer, const std::vector< std::string > &sents, double tolerance) {
+	std::vector< modality::t_decision > ref_decisions, eng_decisions;
+	ref_parser.decisions = &ref_decisions;
+	eng_parser.decisions = &eng_decisions;
+	ref_parser.decision_features = true;
+	eng_parser.decision_features = true;
+
+	unsigned long cnt_decision = 0;
+	for (size_t s=0 ; s<sents.size() ; ++s) {
+		ref_decisions.clear();
+		eng_decisions.clear();
+		std::string ref_out, eng_out;
+		ref_parser.analyzeToString(sents[s], input_layer, ref_out);
+		eng_parser.analyzeToString(sents[s], input_layer, eng_out);
+
+		std::vector< std::string > ref_events, eng_events;
+		event_lines(ref_out, eng_parser.analyze_tags, ref_events);
+		event_lines(eng_out, eng_parser.analyze_tags, eng_events);
+		select_decisions(ref_decisions, eng_parser.analyze_tags);
+		long d = first_divergent(ref_decisions, eng_decisions, tolerance);
+		if (ref_events == eng_events && d < 0) {
+			cnt_decision += ref_decisions.size();
+			continue;
+		}
+
+		std::cout << "layer " << input_layer << ": sentence " << s << " diverges" << std::endl;
+		std::cout << sents[s] << std::endl;
+		for (size_t i=0 ; i<std::max(ref_events.size(), eng_events.size()) ; ++i) {
+			std::string ref_ev = (i < ref_events.size()) ? ref_events[i] : "(none)";
+			std::string eng_ev = (i < eng_events.size()) ? eng_events[i] : "(none)";
+			if (ref_ev != eng_ev) {
+				std::cout << "  reference: " << ref_ev << std::endl;
+				std::cout << "  engine:    " << eng_ev << std::endl;
+			}
+		}
+		if (d >= 0) {
+			std::cout << "  decision " << d << ":" << std::endl;
+			if ((size_t)d < ref_decisions.size()) {
+				print_decision(ref_parser, "reference", ref_decisions[d], std::cout);
+			}
+			if ((size_t)d < eng_decisions.size()) {
+				print_decision(eng_parser, "engine   ", eng_decisions[d], std::cout);
+			}
+			std::cout << "    features:" << std::endl;
+			feature_diff((size_t)d < ref_decisions.size() ? ref_decisions[d].feat_str : "", (size_t)d < eng_decisions.size() ? eng_decisions[d].feat_str : "", std::cout);
+		}
+		return false;
+	}
+	std::cout << "layer " << input_layer << ": " << sents.size() << " sents, " << cnt_decision << " decisions, same" << std::endl;
+	return true;
+}
+
+
+int main(int argc, char *argv[]) {
+	boost::program_options::options_description opt("Usage", 200, 100);
+	opt.add_options()
+		("engine,e", boost::program_options::value<std::string>()->default_value("reference"), "engine compared with the reference path (see --list)")
+		("list", "list the engines")
+		("layers,l", boost::program_options::value<std::string>()->default_value("1"), "comma-separated input layers to replay the generated corpus through\n 0 - raw text layer through CaboCha\n 1 - dependency parsed layer by CaboCha/J.DepP")
+		("corpus,c", boost::program_options::value<std::string>(), "compare on this corpus instead of a generated one (optional); its layer is given by --input")
+		("input,i", boost::program_options::value<int>(), "input layer of --corpus\n 0 - raw text layer\n 1 - dependency parsed layer by CaboCha/J.DepP\n 2 - dependency parsed layer by KNP\n 3 - predicate-argument structure analyzed layer by SynCha/ChaPAS\n 4 - predicate-argument structure analyzed layer by KNP")
+		("fixtures", boost::program_options::value<std::string>()->default_value("test"), "directory of the fixtures the corpus is generated from")
+		("sents,n", boost::program_options::value<unsigned int>()->default_value(1000), "number of generated sentences")
+		("long-parts", boost::program_options::value<unsigned int>()->default_value(8), "also compare sentences joined from this many fixture sentences (0 to skip)")
+		("seed", boost::program_options::value<unsigned int>()->default_value(1), "seed of the generated corpus")
+		("tolerance", boost::program_options::value<double>()->default_value(1e-9), "largest difference of decision values taken as the same")
+		("model,m", boost::program_options::value<std::string>(), "model directory (optional)")
+		("dic,d", boost::program_options::value<std::string>(), "dictionary directory (optional)")
+		("help,h", "Show help messages")
+		("version,v", "Show version information");
+
+	boost::program_options::variables_map argmap;
+	boost::program_options::store(parse_command_line(argc, argv, opt), argmap);
+	boost::program_options::notify(argmap);
+
+	if (argmap.count("help")) {
+		std::cout << opt << std::endl;
+		std::cout << "Exits with 1 when the engine is equivalent to the reference, -1 otherwise." << std::endl;
+		return 1;
+	}
+
+	if (argmap.count("version")) {
+		std::cout << PACKAGE_VERSION << std::endl;
+		return 1;
+	}
+
+	if (argmap.count("list")) {
+		for (unsigned int i=0 ; i<engine_num ; ++i) {
+			std::cout << engines[i].name << "\t" << engines[i].desc << std::endl;
+		}
+		return 1;
+	}
+
+	const t_engine *engine = find_engine(argmap["engine"].as<std::string>());
+	if (engine == NULL) {
+		std::cerr << "ERROR: no such engine " << argmap["engine"].as<std::string>() << std::endl;
+		exit(-1);
+	}
+
+	std::string model_dir = MODELDIR_IPA;
+	if (argmap.count("model")) {
+		model_dir = argmap["model"].as<std::string>();
+	}
+	std::string dic_dir = DICDIR;
+	if (argmap.count("dic")) {
+		dic_dir = argmap["dic"].as<std::string>();
+	}
+
+	std::vector<int> layers;
+	if (argmap.count("corpus")) {
+		if (!argmap.count("input")) {
+			std::cerr << "ERROR: --corpus needs --input" << std::endl;
+			exit(-1);
+		}
+		layers.push_back(argmap["input"].as<int>());
+	}
+	else {
+		std::vector<std::string> vals;
+		boost::algorithm::split(vals, argmap["layers"].as<std::string>(), boost::algorithm::is_any_of(","));
+		BOOST_FOREACH (const std::string &val, vals) {
+			int layer = atoi(val.c_str());
+			// the fixtures are CaboCha format with IPA POS tags
+			if (layer != modality::IN_RAW && layer != modality::IN_DEP_CAB) {
+				std::cerr << "ERROR: the generated corpus is raw text or CaboCha format; give other layers by --corpus" << std::endl;
+				exit(-1);
+			}
+			layers.push_back(layer);
+		}
+	}
+	BOOST_FOREACH (int layer, layers) {
+		if (layer < modality::IN_RAW || layer > modality::IN_PAS_KNP) {
+			std::cerr << "ERROR: invalid input layer" << std::endl;
+			exit(-1);
+		}
+	}
+
+	modality::parser ref_parser(model_dir, dic_dir);
+	modality::parser eng_parser(model_dir, dic_dir);
+	if (!ref_parser.set_pos_tag(modality::POS_IPA, "") || !eng_parser.set_pos_tag(modality::POS_IPA, "")) {
+		return false;
+	}
+	drop_missing_tags(ref_parser, true);
+	drop_missing_tags(eng_parser, false);
+	if (!engine->setup(eng_parser)) {
+		std::cerr << "ERROR: cannot set up engine " << engine->name << std::endl;
+		return false;
+	}
+	if (!ref_parser.load_models() || !eng_parser.load_models()) {
+		std::cerr << "ERROR: load models failed" << std::endl;
+		return false;
+	}
+
+	// the corpora of each layer: fixture-sized sentences, then long ones
+	std::vector< std::vector< std::string > > corpora[modality::IN_NUM];
+	if (argmap.count("corpus")) {
+		corpora[layers[0]].resize(1);
+		read_corpus(argmap["corpus"].as<std::string>(), layers[0], corpora[layers[0]][0]);
+	}
+	else {
+		modality::bench_corpus generator;
+		if (!generator.load_fixtures(argmap["fixtures"].as<std::string>(), ref_parser)) {
+			std::cerr << "ERROR: no sentences in the fixtures" << std::endl;
+			exit(-1);
+		}
+		unsigned int n = argmap["sents"].as<unsigned int>();
+		unsigned int seed = argmap["seed"].as<unsigned int>();
+		unsigned int parts = argmap["long-parts"].as<unsigned int>();
+		for (unsigned int k=0 ; k<2 ; ++k) {
+			if (k == 1 && parts == 0) {
+				break;
+			}
+			std::vector< std::string > raws, cabs;
+			generator.generate(n, seed, raws, cabs, k == 0 ? 2 : parts);
+			corpora[modality::IN_RAW].push_back(raws);
+			corpora[modality::IN_DEP_CAB].push_back(cabs);
+		}
+	}
+
+	std::cout << "engine: " << engine->name << std::endl;
+	if (eng_parser.analyze_tags.size() < ref_parser.analyze_tags.size()) {
+		std::cout << "compared tags:";
+		BOOST_FOREACH (unsigned int i, eng_parser.analyze_tags) {
+			std::cout << " " << eng_parser.id2tag(i);
+		}
+		std::cout << std::endl;
+	}
+	BOOST_FOREACH (int layer, layers) {
+		BOOST_FOREACH (const std::vector< std::string > &sents, corpora[layer]) {
+			if (!compare(ref_parser, eng_parser, layer, sents, argmap["tolerance"].as<double>())) {
+				return -1;
+			}
+		}
+	}
+
+	return 1;
+}
@@ -90,6 +90,11 @@ class evaluator {
 			results.push_back(res);
 		}
 
+
+		void merge( const evaluator &other ) {
+			results.insert(results.end(), other.results.begin(), other.results.end());
+		}
+
 		
 		void eval() {
 			correct_num = 0;
@@ -0,0 +1,282 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <list>
+#include <cmath>
+#include <time.h>
+#include <stdint.h>
+#include <boost/program_options.hpp>
+#include <boost/foreach.hpp>
+#include "sentence.hpp"
+#include "modality.hpp"
+#include "bench_corpus.hpp"
+
+
+enum {
+	FB_BASIC = 0,
+	FB_FUNCTION,
+	FB_DST_CHUNKS,
+	FB_TTJ,
+	FB_FADIC,
+	FB_COMPILE,
+	FB_PACK,
+	FB_NUM
+};
+
+const char *fb_names[FB_NUM] = {
+	"gen_feature_basic",
+	"gen_feature_function",
+	"gen_feature_dst_chunks",
+	"gen_feature_ttj",
+	"gen_feature_fadic",
+	"compile_feat",
+	"pack_feat_linear"
+};
+
+
+typedef struct {
+	nlp::sentence *sent;
+	nlp::chunk *chk;
+	nlp::token *tok;
+} t_instance;
+
+
+uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+double median(std::vector<double> v) {
+	sort(v.begin(), v.end());
+	size_t n = v.size();
+	return (n % 2 == 1) ? v[n/2] : (v[n/2-1] + v[n/2]) / 2.0;
+}
+
+
+/*
+ * generators of every instance, sharing a chunk cache among the instances of
+ * a sentence as analyze() does
+ */
+void make_empty_generators(std::vector< t_instance > &instances, std::list< modality::chunk_cache > &caches, std::vector< modality::feature_generator2 > &fgens) {
+	fgens.clear();
+	BOOST_FOREACH (t_instance &inst, instances) {
+		if (fgens.empty() || fgens.back().sent != inst.sent) {
+			caches.push_back(modality::chunk_cache(inst.sent));
+		}
+		fgens.push_back(modality::feature_generator2(inst.sent, inst.chk, inst.tok, &caches.back()));
+	}
+}
+
+
+/*
+ * generators of every instance with all features generated, as analyze()
+ * leaves them before compiling
+ */
+void make_generators(std::vector< t_instance > &instances, modality::parser &mod_parser, std::list< modality::chunk_cache > &caches, std::vector< modality::feature_generator2 > &fgens) {
+	make_empty_generators(instances, caches, fgens);
+	BOOST_FOREACH (modality::feature_generator2 &fgen, fgens) {
+		fgen.gen_feature_basic(3);
+		fgen.gen_feature_function();
+		fgen.gen_feature_dst_chunks();
+		fgen.gen_feature_ttj(&mod_parser.dbr_ttj);
+		fgen.gen_feature_fadic(&mod_parser.dbr_fadic);
+	}
+}
+
+
+/*
+ * one round of a stage over all instances; only the stage itself is timed,
+ * the generators it needs are made before the clock starts
+ */
+double run_round(unsigned int stage, std::vector< t_instance > &instances, modality::parser &mod_parser) {
+	std::list< modality::chunk_cache > caches;
+	std::vector< modality::feature_generator2 > fgens;
+	std::vector< std::vector< modality::t_feat > > compiled;
+	std::vector< linear::feature_node > xx;
+
+	if (stage == FB_COMPILE || stage == FB_PACK) {
+		make_generators(instances, mod_parser, caches, fgens);
+	}
+	else {
+		make_empty_generators(instances, caches, fgens);
+	}
+	if (stage == FB_PACK) {
+		size_t max_size = 0;
+		compiled.resize(fgens.size());
+		for (size_t i=0 ; i<fgens.size() ; ++i) {
+			BOOST_FOREACH (unsigned int tag_id, mod_parser.analyze_tags) {
+				modality::t_feat feat;
+				fgens[i].compile_feat(mod_parser.use_feats[tag_id], feat);
+				max_size = std::max(max_size, feat.size());
+				compiled[i].push_back(feat);
+			}
+		}
+		xx.resize(max_size+1);
+	}
+
+	uint64_t st = now_ns();
+	for (size_t i=0 ; i<fgens.size() ; ++i) {
+		modality::feature_generator2 &fgen = fgens[i];
+		switch (stage) {
+			case FB_BASIC:
+				fgen.gen_feature_basic(3);
+				break;
+			case FB_FUNCTION:
+				fgen.gen_feature_function();
+				break;
+			case FB_DST_CHUNKS:
+				fgen.gen_feature_dst_chunks();
+				break;
+			case FB_TTJ:
+				fgen.gen_feature_ttj(&mod_parser.dbr_ttj);
+				break;
+			case FB_FADIC:
+				fgen.gen_feature_fadic(&mod_parser.dbr_fadic);
+				break;
+			case FB_COMPILE:
+				BOOST_FOREACH (unsigned int tag_id, mod_parser.analyze_tags) {
+					modality::t_feat feat;
+					fgen.compile_feat(mod_parser.use_feats[tag_id], feat);
+				}
+				break;
+			case FB_PACK:
+				BOOST_FOREACH (modality::t_feat &feat, compiled[i]) {
+					mod_parser.pack_feat_linear(feat, &xx[0]);
+				}
+				break;
+		}
+	}
+	return (now_ns() - st) / (double)fgens.size();
+}
+
+
+void report(const std::string &name, std::vector< t_instance > &instances, modality::parser &mod_parser, unsigned int rounds, unsigned int warmup) {
+	std::cout << name << ": " << instances.size() << " instances, " << rounds << " rounds" << std::endl;
+	for (unsigned int stage=0 ; stage<FB_NUM ; ++stage) {
+		for (unsigned int r=0 ; r<warmup ; ++r) {
+			run_round(stage, instances, mod_parser);
+		}
+		std::vector<double> ns;
+		for (unsigned int r=0 ; r<rounds ; ++r) {
+			ns.push_back(run_round(stage, instances, mod_parser));
+		}
+		// median and median absolute deviation are not moved by a few slow rounds
+		double med = median(ns);
+		std::vector<double> dev;
+		BOOST_FOREACH (double v, ns) {
+			dev.push_back(std::fabs(v - med));
+		}
+		std::cout << "  " << std::left << std::setw(24) << fb_names[stage] << std::right << std::fixed << std::setprecision(1);
+		std::cout << " median " << std::setw(10) << med << " ns/inst, mad " << std::setw(8) << median(dev) << ", min " << std::setw(10) << *std::min_element(ns.begin(), ns.end()) << std::endl;
+		std::cout.unsetf(std::ios::fixed);
+	}
+}
+
+
+void parse_corpus(const std::vector< std::string > &cabs, modality::parser &mod_parser, std::vector< nlp::sentence > &sents, std::vector< t_instance > &instances) {
+	sents.resize(cabs.size());
+	for (size_t i=0 ; i<cabs.size() ; ++i) {
+		// targets and the tags of the following targets are given by the models
+		mod_parser.analyze(cabs[i], modality::IN_DEP_CAB, sents[i]);
+	}
+	BOOST_FOREACH (nlp::sentence &sent, sents) {
+		BOOST_FOREACH (nlp::chunk &chk, sent.chunks) {
+			BOOST_FOREACH (nlp::token &tok, chk.tokens) {
+				if (tok.has_mod) {
+					t_instance inst;
+					inst.sent = &sent;
+					inst.chk = &chk;
+					inst.tok = &tok;
+					instances.push_back(inst);
+				}
+			}
+		}
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	boost::program_options::options_description opt("Usage", 200, 100);
+	opt.add_options()
+		("fixtures", boost::program_options::value<std::string>()->default_value("test"), "directory of the fixtures sentences are made from")
+		("sents,n", boost::program_options::value<unsigned int>()->default_value(200), "number of sentences of each set")
+		("long-parts", boost::program_options::value<unsigned int>()->default_value(8), "number of fixture sentences joined into a long sentence")
+		("seed", boost::program_options::value<unsigned int>()->default_value(1), "seed of the generated sentences")
+		("rounds,r", boost::program_options::value<unsigned int>()->default_value(15), "measured rounds of each stage")
+		("warmup", boost::program_options::value<unsigned int>()->default_value(2), "rounds of each stage before measuring")
+		("model,m", boost::program_options::value<std::string>(), "model directory (optional)")
+		("dic,d", boost::program_options::value<std::string>(), "dictionary directory (optional)")
+		("help,h", "Show help messages")
+		("version,v", "Show version information");
+
+	boost::program_options::variables_map argmap;
+	boost::program_options::store(parse_command_line(argc, argv, opt), argmap);
+	boost::program_options::notify(argmap);
+
+	if (argmap.count("help")) {
+		std::cout << opt << std::endl;
+		return 1;
+	}
+
+	if (argmap.count("version")) {
+		std::cout << PACKAGE_VERSION << std::endl;
+		return 1;
+	}
+
+	std::string model_dir = MODELDIR_IPA;
+	if (argmap.count("model")) {
+		model_dir = argmap["model"].as<std::string>();
+	}
+	std::string dic_dir = DICDIR;
+	if (argmap.count("dic")) {
+		dic_dir = argmap["dic"].as<std::string>();
+	}
+
+	unsigned int rounds = argmap["rounds"].as<unsigned int>();
+	if (rounds == 0) {
+		std::cerr << "ERROR: --rounds must be 1 or more" << std::endl;
+		exit(-1);
+	}
+
+	modality::parser mod_parser(model_dir, dic_dir);
+	if (!mod_parser.set_pos_tag(modality::POS_IPA, "")) {
+		return false;
+	}
+	if (!mod_parser.load_models()) {
+		std::cerr << "ERROR: load models failed" << std::endl;
+		return false;
+	}
+
+	modality::bench_corpus generator;
+	if (!generator.load_fixtures(argmap["fixtures"].as<std::string>(), mod_parser)) {
+		std::cerr << "ERROR: no sentences in the fixtures" << std::endl;
+		exit(-1);
+	}
+
+	unsigned int n = argmap["sents"].as<unsigned int>();
+	unsigned int seed = argmap["seed"].as<unsigned int>();
+	unsigned int warmup = argmap["warmup"].as<unsigned int>();
+	std::vector< std::string > raws, cabs;
+
+	// fixture-sized sentences, then long ones
+	generator.generate(n, seed, raws, cabs);
+	std::vector< nlp::sentence > sents;
+	std::vector< t_instance > instances;
+	parse_corpus(cabs, mod_parser, sents, instances);
+	if (!instances.empty()) {
+		report("sentences", instances, mod_parser, rounds, warmup);
+	}
+
+	unsigned int parts = argmap["long-parts"].as<unsigned int>();
+	generator.generate(n, seed, raws, cabs, parts);
+	std::vector< nlp::sentence > long_sents;
+	std::vector< t_instance > long_instances;
+	parse_corpus(cabs, mod_parser, long_sents, long_instances);
+	if (!long_instances.empty()) {
+		report("long sentences (" + boost::lexical_cast<std::string>(parts) + " parts)", long_instances, mod_parser, rounds, warmup);
+	}
+
+	return 1;
+}
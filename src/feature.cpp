@@ -14,9 +14,10 @@
 
 
 namespace modality {
-	void feature_generator2::gen_feature_mod(const std::string &tag) {
+	void feature_generator2::gen_feature_mod(unsigned int tag) {
+		stat_timer timer(ST_GEN_MOD);
 		if (tok_core->has_mod) {
-			feat_cat["mod_" + tag][tok_core->mod.tag[tag]] = 1.0;
+			feat_cat["mod_" + nlp::modality::tag_name(tag)][tok_core->mod.get(tag)] = 1.0;
 		}
 	}
 
@@ -52,10 +53,71 @@ namespace modality {
 	}
 
 
+	const std::vector<std::string> *chunk_cache::dst_chunk_feats(const nlp::chunk &chk) {
+		if (chk.id < 0 || (size_t)chk.id >= dst_feats.size() || &sent->chunks[chk.id] != &chk) {
+			return NULL;
+		}
+		// a chunk has tokens, so its features are never empty once made
+		std::vector<std::string> &feats = dst_feats[chk.id];
+		if (feats.empty()) {
+			make_dst_feats(chk, feats);
+		}
+		return &feats;
+	}
+
+
+	const std::string *chunk_cache::func_suffix(const nlp::chunk &chk, const nlp::token &tok) {
+		if (chk.id < 0 || (size_t)chk.id >= suffixes.size() || &sent->chunks[chk.id] != &chk) {
+			return NULL;
+		}
+		if (chk.tokens.empty() || &tok < &chk.tokens[0] || &chk.tokens.back() < &tok) {
+			return NULL;
+		}
+		std::vector<std::string> &suffix = suffixes[chk.id];
+		if (suffix.empty()) {
+			make_suffixes(chk, suffix);
+		}
+		return &suffix[&tok - &chk.tokens[0]];
+	}
+
+
+	void chunk_cache::make_dst_feats(const nlp::chunk &chk, std::vector<std::string> &feats) {
+		std::string surf, orig;
+		BOOST_FOREACH (const nlp::token &tok, chk.tokens) {
+			surf += tok.surf;
+			orig += tok.orig;
+		}
+		feats.push_back("dst_surf_" + surf);
+		feats.push_back("dst_orig_" + orig);
+		int tid = 0;
+		BOOST_FOREACH (const nlp::token &tok, chk.tokens) {
+			std::string tid_str = boost::lexical_cast<std::string>(tid);
+			feats.push_back("dst_tok_surf_" + tid_str + "_" + tok.surf);
+			feats.push_back("dst_tok_orig_" + tid_str + "_" + tok.orig);
+			tid++;
+		}
+	}
+
+
+	// suffixes[k]: surfaces of the tokens after the k-th one, each followed by "."
+	void chunk_cache::make_suffixes(const nlp::chunk &chk, std::vector<std::string> &suffixes) {
+		suffixes.assign(chk.tokens.size(), std::string());
+		for (size_t k=chk.tokens.size() ; k>1 ; --k) {
+			suffixes[k-2] = chk.tokens[k-1].surf + "." + suffixes[k-1];
+		}
+	}
+
+
 	void feature_generator2::gen_feature_function() {
-		std::string func_ex;
+		stat_timer timer(ST_GEN_FUNCTION);
+		const std::string *cached = (cache != NULL) ? cache->func_suffix(*chk_core, *tok_core) : NULL;
+		if (cached != NULL) {
+			feat_cat["func_surf"][*cached] = 1.0;
+			return;
+		}
 
-		BOOST_FOREACH ( nlp::token tok, chk_core->tokens ) {
+		std::string func_ex;
+		BOOST_FOREACH ( const nlp::token &tok, chk_core->tokens ) {
 			if (tok_core->id < tok.id) {
 				func_ex += tok.surf + ".";
 			}
@@ -66,6 +128,7 @@ namespace modality {
 
 
 	void feature_generator2::gen_feature_basic(const int n) {
+		stat_timer timer(ST_GEN_BASIC);
 		BOOST_FOREACH(nlp::chunk chk, sent->chunks) {
 			BOOST_FOREACH(nlp::token tok, chk.tokens) {
 				if (tok_core->id <= tok.id + n && tok.id - n <= tok_core->id && tok_core->id != tok.id) {
@@ -83,30 +146,63 @@ namespace modality {
 	}
 
 
+	/*
+	 * features of the target detector of DETECT_BY_ML, only from the token,
+	 * its neighbours and its chunk, so that they cost little next to the
+	 * features of the tags
+	 */
+	void feature_generator2::gen_feature_target() {
+		t_feat &feat = feat_cat["target"];
+		feat["pos_" + tok_core->pos + "," + tok_core->pos1] = 1.0;
+		feat["orig_" + tok_core->orig] = 1.0;
+		feat["form_" + tok_core->form] = 1.0;
+
+		nlp::token *tok = sent->get_token(tok_core->id-1);
+		if (tok != NULL) {
+			feat["p1_pos_" + tok->pos + "," + tok->pos1] = 1.0;
+		}
+		tok = sent->get_token(tok_core->id+1);
+		if (tok != NULL) {
+			feat["n1_pos_" + tok->pos + "," + tok->pos1] = 1.0;
+			feat["n1_orig_" + tok->orig] = 1.0;
+			tok = sent->get_token(tok_core->id+2);
+			if (tok != NULL) {
+				feat["n2_pos_" + tok->pos + "," + tok->pos1] = 1.0;
+			}
+		}
+
+		if (chk_core->tokens.back().id == tok_core->id) {
+			feat["chunk_last"] = 1.0;
+		}
+		if (chk_core->dst == -1) {
+			feat["chunk_root"] = 1.0;
+		}
+	}
+
+
 	void feature_generator2::gen_feature_dst_chunks() {
+		stat_timer timer(ST_GEN_DST_CHUNKS);
 		nlp::chunk *chk_dst;
 		chk_dst = sent->get_dst_chunk(*chk_core);
-		for (unsigned int i=1 ; i<3 ; ++i) {
-			if (chk_core->dst != -1) {
-				std::string chk_str;
-				chk_dst->str(chk_str);
-				feat_cat["chunk"]["dst_surf_" + chk_str] = 1.0;
-				chk_dst->str_orig(chk_str);
-				feat_cat["chunk"]["dst_orig_" + chk_str] = 1.0;
-				int tid = 0;
-				BOOST_FOREACH (nlp::token tok, chk_dst->tokens) {
-					std::stringstream ss;
-					ss << tid;
-					feat_cat["chunk"]["dst_tok_surf_" + ss.str() + "_" + tok.surf] = 1.0;
-					feat_cat["chunk"]["dst_tok_orig_" + ss.str() + "_" + tok.orig] = 1.0;
-					tid++;
-				}
-			}
+		if (chk_dst == NULL) {
+			return;
+		}
+
+		const std::vector<std::string> *feats = (cache != NULL) ? cache->dst_chunk_feats(*chk_dst) : NULL;
+		std::vector<std::string> made;
+		if (feats == NULL) {
+			chunk_cache::make_dst_feats(*chk_dst, made);
+			feats = &made;
+		}
+		t_feat &feat = feat_cat["chunk"];
+		BOOST_FOREACH (const std::string &f, *feats) {
+			feat[f] = 1.0;
 		}
 	}
 
 
 	void feature_generator2::gen_feature_ttj(cdbpp::cdbpp *dbr_ttj) {
+		stat_timer timer(ST_GEN_TTJ);
 		int tok_id_start = tok_core->id;
 		std::vector< t_match_func > match_funcs;
 
@@ -114,6 +210,7 @@ namespace modality {
 			std::vector< t_match_func > match_funcs_local;
 			if (tok.id > tok_id_start) {
 				size_t vsize;
+				stats::count(SC_CDB_LOOKUPS);
 				const char *value = (const char *)dbr_ttj->get(tok.surf.c_str(), tok.surf.length(), &vsize);
 				if (value != NULL) {
 					std::string val = std::string(value, vsize);
@@ -227,13 +324,22 @@ namespace modality {
 
 
 	void feature_generator2::gen_feature_fadic(cdbpp::cdbpp *dbr_fadic) {
+		stat_timer timer(ST_GEN_FADIC);
+		static const unsigned int future = nlp::mod_labels::id("未来");
+		static const unsigned int present = nlp::mod_labels::id("非未来");
+		static const unsigned int auth_pos[4] = {
+			nlp::mod_labels::id("成立"),
+			nlp::mod_labels::id("高確率"),
+			nlp::mod_labels::id("不成立から成立"),
+			nlp::mod_labels::id("低確率から高確率")
+		};
 		std::string tense, auth;
 
 		if (tok_core->has_mod) {
-			if (tok_core->mod.tag["tense"] == "未来") {
+			if (tok_core->mod.tag[nlp::MOD_TENSE] == future) {
 				tense = "future";
 			}
-			else if (tok_core->mod.tag["tense"] == "非未来") {
+			else if (tok_core->mod.tag[nlp::MOD_TENSE] == present) {
 				tense = "present";
 			}
 			else {
@@ -249,10 +355,11 @@ namespace modality {
 			nlp::chunk *chk_dst = sent->get_chunk(chk_core->dst);
 			tok_dst = chk_dst->get_token_has_mod();
 			if (tok_dst != NULL) {
-				if (tok_dst->mod.tag["authenticity"] == "成立" || tok_dst->mod.tag["authenticity"] == "高確率" || tok_dst->mod.tag["authenticity"] == "不成立から成立" || tok_dst->mod.tag["authenticity"] == "低確率から高確率") {
+				unsigned int dst_auth = tok_dst->mod.tag[nlp::MOD_AUTHENTICITY];
+				if (dst_auth == auth_pos[0] || dst_auth == auth_pos[1] || dst_auth == auth_pos[2] || dst_auth == auth_pos[3]) {
 					auth = "pos";
 				}
-				else if (tok_dst->mod.tag["authenticity"] == "0") {
+				else if (dst_auth == nlp::mod_labels::DEFAULT) {
 					auth = "";
 				}
 				else {
@@ -275,6 +382,7 @@ namespace modality {
 				std::cerr << " lookup fadic: " << it->first;
 #endif
 				size_t vsize;
+				stats::count(SC_CDB_LOOKUPS);
 				const char *value = (const char *)dbr_fadic->get(it->second.c_str(), it->second.length(), &vsize);
 				if (value != NULL) {
 					std::string val = std::string(value, vsize);
@@ -0,0 +1,417 @@
+#ifndef __FEATURE_MATRIX_HPP__
+#define __FEATURE_MATRIX_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/unordered_map.hpp>
+#include <boost/foreach.hpp>
+
+namespace linear {
+#include "../liblinear-1.8/linear.h"
+};
+
+namespace modality {
+	/*
+	 * Sparse instance matrix of one tag in CSR layout. Each row in nodes is
+	 * terminated by a node of index -1, so that rows can be passed to liblinear
+	 * as they are.
+	 *
+	 * Binary file layout (native byte order):
+	 *   "ZFM2", uint64 rows, uint64 nnz, uint64 cols,
+	 *   int32 y[rows], uint64 row_ptr[rows+1],
+	 *   int32 index[nnz], double value[nnz]
+	 * where row_ptr and nnz do not count the terminators and cols is the
+	 * number of features (problem.n) the rows were packed for; feature ids
+	 * start at 1, so every index is in [1, cols-1].
+	 */
+	class feature_matrix {
+		public:
+			std::vector<int> y;
+			// offset of each row in nodes (rows+1 entries)
+			std::vector<size_t> row_ptr;
+			std::vector<linear::feature_node> nodes;
+		private:
+			std::vector<linear::feature_node*> x;
+
+		public:
+			feature_matrix() {
+				row_ptr.push_back(0);
+			}
+
+			size_t rows() const {
+				return y.size();
+			}
+
+			void clear() {
+				y.clear();
+				row_ptr.clear();
+				row_ptr.push_back(0);
+				nodes.clear();
+				x.clear();
+			}
+
+			linear::feature_node *row(size_t i) {
+				return &nodes[row_ptr[i]];
+			}
+
+			void add_row(int label, const linear::feature_node *xx) {
+				y.push_back(label);
+				for ( ; xx->index != -1 ; ++xx) {
+					nodes.push_back(*xx);
+				}
+				linear::feature_node term;
+				term.index = -1;
+				term.value = 0.0;
+				nodes.push_back(term);
+				row_ptr.push_back(nodes.size());
+			}
+
+			// largest feature index of the rows, 0 when they have none
+			int max_index() const {
+				int m = 0;
+				BOOST_FOREACH (const linear::feature_node &node, nodes) {
+					if (node.index > m) {
+						m = node.index;
+					}
+				}
+				return m;
+			}
+
+			// rows as liblinear wants them; valid until the matrix is modified
+			void problem(linear::problem *prob, int n) {
+				x.clear();
+				for (size_t i=0 ; i<rows() ; ++i) {
+					x.push_back(&nodes[row_ptr[i]]);
+				}
+				prob->l = rows();
+				prob->n = n;
+				prob->y = y.empty() ? NULL : &y[0];
+				prob->x = x.empty() ? NULL : &x[0];
+				prob->bias = -1;
+			}
+
+			bool save(const std::string &path, uint64_t n_cols) const {
+				std::ofstream ofs(path.c_str(), std::ios_base::binary);
+				if (!ofs) {
+					return false;
+				}
+				uint64_t n_rows = rows();
+				uint64_t nnz = nodes.size() - rows();
+				ofs.write("ZFM2", 4);
+				ofs.write((const char *)&n_rows, sizeof(n_rows));
+				ofs.write((const char *)&nnz, sizeof(nnz));
+				ofs.write((const char *)&n_cols, sizeof(n_cols));
+				BOOST_FOREACH (int label, y) {
+					int32_t l = label;
+					ofs.write((const char *)&l, sizeof(l));
+				}
+				for (size_t i=0 ; i<=rows() ; ++i) {
+					// row i starts after i terminators
+					uint64_t p = row_ptr[i] - i;
+					ofs.write((const char *)&p, sizeof(p));
+				}
+				BOOST_FOREACH (const linear::feature_node &node, nodes) {
+					if (node.index != -1) {
+						int32_t index = node.index;
+						ofs.write((const char *)&index, sizeof(index));
+					}
+				}
+				BOOST_FOREACH (const linear::feature_node &node, nodes) {
+					if (node.index != -1) {
+						ofs.write((const char *)&node.value, sizeof(node.value));
+					}
+				}
+				return ofs.good();
+			}
+
+			// n_cols: set to the cols of the file
+			bool load(const std::string &path, uint64_t &n_cols) {
+				clear();
+				std::ifstream ifs(path.c_str(), std::ios_base::binary);
+				char magic[4];
+				uint64_t n_rows, nnz;
+				if (!ifs.read(magic, 4) || std::string(magic, 4) != "ZFM2") {
+					return false;
+				}
+				ifs.read((char *)&n_rows, sizeof(n_rows));
+				ifs.read((char *)&nnz, sizeof(nnz));
+				ifs.read((char *)&n_cols, sizeof(n_cols));
+				// a broken header would otherwise make the vectors below huge
+				struct stat st;
+				if (!ifs || stat(path.c_str(), &st) != 0) {
+					return false;
+				}
+				uint64_t body = sizeof(int32_t) * n_rows + sizeof(uint64_t) * (n_rows+1) + (sizeof(int32_t) + sizeof(double)) * nnz;
+				if ((uint64_t)st.st_size != 4 + sizeof(uint64_t) * 3 + body) {
+					return false;
+				}
+
+				std::vector<int32_t> labels(n_rows);
+				std::vector<uint64_t> ptr(n_rows+1);
+				std::vector<int32_t> index(nnz);
+				std::vector<double> value(nnz);
+				if (n_rows > 0) {
+					ifs.read((char *)&labels[0], sizeof(int32_t) * n_rows);
+				}
+				ifs.read((char *)&ptr[0], sizeof(uint64_t) * (n_rows+1));
+				if (nnz > 0) {
+					ifs.read((char *)&index[0], sizeof(int32_t) * nnz);
+					ifs.read((char *)&value[0], sizeof(double) * nnz);
+				}
+				if (!ifs || !valid(ptr, index, nnz, n_cols)) {
+					clear();
+					return false;
+				}
+
+				nodes.reserve(nnz + n_rows);
+				for (uint64_t i=0 ; i<n_rows ; ++i) {
+					y.push_back(labels[i]);
+					for (uint64_t j=ptr[i] ; j<ptr[i+1] ; ++j) {
+						linear::feature_node node;
+						node.index = index[j];
+						node.value = value[j];
+						nodes.push_back(node);
+					}
+					linear::feature_node term;
+					term.index = -1;
+					term.value = 0.0;
+					nodes.push_back(term);
+					row_ptr.push_back(nodes.size());
+				}
+				return true;
+			}
+
+		private:
+			// row_ptr of a file is non-decreasing from 0 to nnz, and indices are in [1, n_cols-1]
+			static bool valid(const std::vector<uint64_t> &ptr, const std::vector<int32_t> &index, uint64_t nnz, uint64_t n_cols) {
+				if (ptr[0] != 0 || ptr.back() != nnz) {
+					return false;
+				}
+				for (size_t i=0 ; i+1<ptr.size() ; ++i) {
+					if (ptr[i] > ptr[i+1] || ptr[i+1] > nnz) {
+						return false;
+					}
+				}
+				BOOST_FOREACH (int32_t idx, index) {
+					if (idx < 1 || (uint64_t)idx >= n_cols) {
+						return false;
+					}
+				}
+				return true;
+			}
+	};
+
+
+	/*
+	 * Rows of one tag appended to disk while the input is read:
+	 *   <path>.nodes - feature_node records of every row, each terminated by
+	 *                  index -1, in native layout so that it can be mapped
+	 *   <path>.y     - int32 label of every row
+	 */
+	class feature_spill {
+		private:
+			std::string path;
+			FILE *fp_nodes;
+			FILE *fp_y;
+			size_t n_rows;
+
+		public:
+			feature_spill() {
+				fp_nodes = NULL;
+				fp_y = NULL;
+				n_rows = 0;
+			}
+
+			~feature_spill() {
+				close();
+			}
+
+			bool open(const std::string &_path) {
+				close();
+				path = _path;
+				n_rows = 0;
+				fp_nodes = fopen((path + ".nodes").c_str(), "wb");
+				fp_y = fopen((path + ".y").c_str(), "wb");
+				return fp_nodes != NULL && fp_y != NULL;
+			}
+
+			bool close() {
+				bool ok = true;
+				if (fp_nodes != NULL) {
+					ok = !ferror(fp_nodes) && (fclose(fp_nodes) == 0) && ok;
+					fp_nodes = NULL;
+				}
+				if (fp_y != NULL) {
+					ok = !ferror(fp_y) && (fclose(fp_y) == 0) && ok;
+					fp_y = NULL;
+				}
+				return ok;
+			}
+
+			size_t rows() const {
+				return n_rows;
+			}
+
+			void add_row(int label, const linear::feature_node *xx) {
+				const linear::feature_node *end = xx;
+				while (end->index != -1) {
+					++end;
+				}
+				// with the terminator
+				fwrite(xx, sizeof(linear::feature_node), end - xx + 1, fp_nodes);
+				int32_t l = label;
+				fwrite(&l, sizeof(l), 1, fp_y);
+				++n_rows;
+			}
+
+			void remove() {
+				close();
+				::remove((path + ".nodes").c_str());
+				::remove((path + ".y").c_str());
+			}
+	};
+
+
+	/*
+	 * Rows written by feature_spill, mapped read-only into memory. Only labels
+	 * and row pointers are kept in memory.
+	 */
+	class mapped_matrix {
+		public:
+			std::vector<int> y;
+		private:
+			std::vector<linear::feature_node*> x;
+			void *addr;
+			size_t length;
+
+		public:
+			mapped_matrix() {
+				addr = NULL;
+				length = 0;
+			}
+
+			~mapped_matrix() {
+				unmap();
+			}
+
+			size_t rows() const {
+				return y.size();
+			}
+
+			bool map(const std::string &path) {
+				unmap();
+				std::ifstream ifs((path + ".y").c_str(), std::ios_base::binary);
+				int32_t l;
+				while (ifs.read((char *)&l, sizeof(l))) {
+					y.push_back(l);
+				}
+
+				int fd = ::open((path + ".nodes").c_str(), O_RDONLY);
+				if (fd < 0) {
+					return false;
+				}
+				struct stat st;
+				if (fstat(fd, &st) != 0) {
+					::close(fd);
+					return false;
+				}
+				length = st.st_size;
+				if (length > 0) {
+					// private, so that pages are shared with the page cache until written
+					addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+				}
+				::close(fd);
+				if (addr == MAP_FAILED) {
+					addr = NULL;
+					return false;
+				}
+
+				linear::feature_node *node = (linear::feature_node *)addr;
+				linear::feature_node *end = node + length / sizeof(linear::feature_node);
+				while (node < end) {
+					x.push_back(node);
+					while (node->index != -1) {
+						++node;
+					}
+					++node;
+				}
+				return x.size() == y.size();
+			}
+
+			void unmap() {
+				if (addr != NULL) {
+					munmap(addr, length);
+					addr = NULL;
+				}
+				length = 0;
+				x.clear();
+				y.clear();
+			}
+
+			void problem(linear::problem *prob, int n) {
+				prob->l = rows();
+				prob->n = n;
+				prob->y = y.empty() ? NULL : &y[0];
+				prob->x = x.empty() ? NULL : &x[0];
+				prob->bias = -1;
+			}
+	};
+
+
+	/*
+	 * string -> id maps (feat2id, label2id) in binary:
+	 *   uint64 size, then size times (uint32 length, bytes, int32 id)
+	 */
+	inline bool save_str2id(const boost::unordered_map<std::string, int> &map, const std::string &path) {
+		std::ofstream ofs(path.c_str(), std::ios_base::binary);
+		if (!ofs) {
+			return false;
+		}
+		uint64_t size = map.size();
+		ofs.write((const char *)&size, sizeof(size));
+		boost::unordered_map<std::string, int>::const_iterator it;
+		for (it=map.begin() ; it!=map.end() ; ++it) {
+			uint32_t len = it->first.size();
+			int32_t id = it->second;
+			ofs.write((const char *)&len, sizeof(len));
+			ofs.write(it->first.data(), len);
+			ofs.write((const char *)&id, sizeof(id));
+		}
+		return ofs.good();
+	}
+
+	inline bool load_str2id(boost::unordered_map<std::string, int> &map, const std::string &path) {
+		std::ifstream ifs(path.c_str(), std::ios_base::binary);
+		uint64_t size;
+		if (!ifs.read((char *)&size, sizeof(size))) {
+			return false;
+		}
+		map.clear();
+		std::string key;
+		for (uint64_t i=0 ; i<size ; ++i) {
+			uint32_t len;
+			int32_t id;
+			ifs.read((char *)&len, sizeof(len));
+			key.resize(len);
+			if (len > 0) {
+				ifs.read(&key[0], len);
+			}
+			ifs.read((char *)&id, sizeof(id));
+			if (!ifs) {
+				return false;
+			}
+			map[key] = id;
+		}
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef __KNP_POOL_HPP__
+#define __KNP_POOL_HPP__
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+namespace modality {
+	/*
+	 * Pool of long-lived "juman | knp -tab" processes.
+	 * A sentence is written to a worker as one line and its analysis is read
+	 * back up to the line "EOS". Sentences of a batch are dispatched across the
+	 * workers concurrently and their results are returned in input order.
+	 */
+	class knp_pool {
+		private:
+			typedef struct {
+				pid_t pid;
+				FILE *in;
+				FILE *out;
+			} t_worker;
+
+			std::string command;
+			std::vector< t_worker > workers;
+
+			const std::vector< std::string > *texts;
+			std::vector< std::vector< std::string > > *results;
+			unsigned int next_text;
+			bool failed;
+			// guards next_text and failed
+			boost::mutex mtx;
+			// one request or batch at a time
+			boost::mutex batch_mtx;
+			// guards the start of workers
+			boost::mutex start_mtx;
+
+		public:
+			knp_pool(const std::string &_command, unsigned int n_workers) {
+				command = _command;
+				texts = NULL;
+				results = NULL;
+				next_text = 0;
+				failed = false;
+				if (n_workers == 0) {
+					n_workers = 1;
+				}
+				workers.resize(n_workers);
+				for (unsigned int i=0 ; i<n_workers ; ++i) {
+					start_worker(workers[i]);
+				}
+			}
+
+			~knp_pool() {
+				for (unsigned int i=0 ; i<workers.size() ; ++i) {
+					// EOF on stdin lets the worker exit
+					fclose(workers[i].in);
+					fclose(workers[i].out);
+					waitpid(workers[i].pid, NULL, 0);
+				}
+			}
+
+			unsigned int size() const {
+				return workers.size();
+			}
+
+			bool parse(const std::string &text, std::vector< std::string > &lines) {
+				boost::mutex::scoped_lock lock(batch_mtx);
+				return parse(workers[0], text, lines);
+			}
+
+			bool parse_all(const std::vector< std::string > &_texts, std::vector< std::vector< std::string > > &_results) {
+				boost::mutex::scoped_lock lock_batch(batch_mtx);
+				texts = &_texts;
+				results = &_results;
+				results->clear();
+				results->resize(texts->size());
+				next_text = 0;
+				failed = false;
+
+				unsigned int n_threads = workers.size();
+				if (n_threads > texts->size()) {
+					n_threads = texts->size();
+				}
+				boost::thread_group threads;
+				for (unsigned int i=0 ; i<n_threads ; ++i) {
+					threads.create_thread( boost::bind(&knp_pool::run_worker, this, i) );
+				}
+				threads.join_all();
+				return !failed;
+			}
+
+		private:
+			void start_worker(t_worker &worker) {
+				// a worker restarted by one thread must not inherit the pipes
+				// of another one being started
+				boost::mutex::scoped_lock lock(start_mtx);
+				int to_child[2], from_child[2];
+				if (pipe(to_child) != 0 || pipe(from_child) != 0) {
+					std::cerr << "ERROR: cannot create pipes for \"" << command << "\"" << std::endl;
+					exit(-1);
+				}
+				// the ends kept by this process must not leak into later workers
+				fcntl(to_child[1], F_SETFD, FD_CLOEXEC);
+				fcntl(from_child[0], F_SETFD, FD_CLOEXEC);
+
+				pid_t pid = fork();
+				if (pid < 0) {
+					std::cerr << "ERROR: cannot fork \"" << command << "\"" << std::endl;
+					exit(-1);
+				}
+				if (pid == 0) {
+					// signals blocked for the stats watcher are not for the command
+					sigset_t set;
+					sigemptyset(&set);
+					sigprocmask(SIG_SETMASK, &set, NULL);
+					dup2(to_child[0], STDIN_FILENO);
+					dup2(from_child[1], STDOUT_FILENO);
+					close(to_child[0]);
+					close(from_child[1]);
+					execl("/bin/sh", "sh", "-c", command.c_str(), (char *)NULL);
+					_exit(127);
+				}
+				close(to_child[0]);
+				close(from_child[1]);
+
+				worker.pid = pid;
+				worker.in = fdopen(to_child[1], "w");
+				worker.out = fdopen(from_child[0], "r");
+			}
+
+			// reaps a worker that failed and starts another one in its place
+			void restart_worker(t_worker &worker) {
+				fclose(worker.in);
+				fclose(worker.out);
+				kill(worker.pid, SIGTERM);
+				waitpid(worker.pid, NULL, 0);
+				start_worker(worker);
+			}
+
+			void run_worker(unsigned int worker_id) {
+				while (true) {
+					unsigned int i;
+					{
+						boost::mutex::scoped_lock lock(mtx);
+						if (failed || next_text >= texts->size()) {
+							return;
+						}
+						i = next_text++;
+					}
+					if (!parse(workers[worker_id], (*texts)[i], (*results)[i])) {
+						boost::mutex::scoped_lock lock(mtx);
+						failed = true;
+						return;
+					}
+				}
+			}
+
+			/*
+			 * SIGPIPE from a dead worker is blocked on the calling thread only,
+			 * and taken back before it is unblocked, so that the disposition of
+			 * the process is left as it is; the failure is reported by the
+			 * return value and the worker is restarted for later sentences.
+			 */
+			bool parse(t_worker &worker, const std::string &text, std::vector< std::string > &lines) {
+				sigset_t pipe_set, old_set;
+				sigemptyset(&pipe_set);
+				sigaddset(&pipe_set, SIGPIPE);
+				pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+				bool ok = talk(worker, text, lines);
+				if (!ok) {
+					restart_worker(worker);
+					struct timespec zero = {0, 0};
+					while (sigtimedwait(&pipe_set, NULL, &zero) > 0) {
+					}
+				}
+				pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+				return ok;
+			}
+
+			bool talk(t_worker &worker, const std::string &text, std::vector< std::string > &lines) {
+				// one sentence per line
+				std::string line = text;
+				for (std::string::iterator it=line.begin() ; it!=line.end() ; ++it) {
+					if (*it == '\n' || *it == '\r') {
+						*it = ' ';
+					}
+				}
+				line += "\n";
+				if (fputs(line.c_str(), worker.in) == EOF || fflush(worker.in) != 0) {
+					std::cerr << "ERROR: cannot write to \"" << command << "\"" << std::endl;
+					return false;
+				}
+
+				lines.clear();
+				std::string buf;
+				char chunk[4096];
+				while (fgets(chunk, sizeof(chunk), worker.out) != NULL) {
+					buf += chunk;
+					if (buf.empty() || buf[buf.size()-1] != '\n') {
+						continue;
+					}
+					buf.erase(buf.size()-1);
+					lines.push_back(buf);
+					if (buf == "EOS") {
+						return true;
+					}
+					buf.clear();
+				}
+				std::cerr << "ERROR: \"" << command << "\" exited before EOS" << std::endl;
+				return false;
+			}
+	};
+};
+
+#endif
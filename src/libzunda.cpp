@@ -0,0 +1,229 @@
+#include <iostream>
+#include <string>
+#include <list>
+#include <boost/unordered_set.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/static_assert.hpp>
+#include "zunda.h"
+#include "sentence.hpp"
+#include "modality.hpp"
+
+
+/*
+ * The parser is shared by the threads of a handle; analysis only reads it
+ * except for the memo maps of feat2id and id2label, which are guarded.
+ * Labels are interned when the handle is made so that the results can point
+ * to them without locking.
+ */
+struct zunda_t {
+	modality::parser *mod_parser;
+	int pos_tag;
+	boost::unordered_set< std::string > labels;
+	// labels not known when the handle was made
+	boost::mutex late_mtx;
+	std::list< std::string > late_labels;
+};
+
+
+// the tags of zunda.h are those of the modality of a token
+BOOST_STATIC_ASSERT((int)ZUNDA_TAG_NUM == (int)nlp::MOD_TAG_NUM);
+
+
+static const char *intern(zunda_t *z, const std::string &label) {
+	boost::unordered_set< std::string >::const_iterator it = z->labels.find(label);
+	if (it != z->labels.end()) {
+		return it->c_str();
+	}
+	boost::mutex::scoped_lock lock(z->late_mtx);
+	BOOST_FOREACH (const std::string &l, z->late_labels) {
+		if (l == label) {
+			return l.c_str();
+		}
+	}
+	z->late_labels.push_back(label);
+	return z->late_labels.back().c_str();
+}
+
+
+static std::string field(const char *f) {
+	return (f == NULL || *f == '\0') ? "*" : f;
+}
+
+
+static bool ends_with(const std::string &str, const std::string &suffix) {
+	return str.size() >= suffix.size() && str.compare(str.size()-suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+// as token::parse_mecab and token::parse_mecab_juman read a CaboCha line
+static void make_token(const zunda_morph_t &m, int tok_id, int pos_tag, nlp::token &tok) {
+	tok.id = tok_id;
+	tok.surf = field(m.surface);
+	tok.pos = field(m.pos[0]);
+	if (pos_tag == modality::POS_JUMAN) {
+		tok.orig = field(m.lemma);
+		tok.read = field(m.reading);
+		if (ends_with(tok.pos, tok.judge_pos_juman)) {
+			tok.pos1 = field(m.pos[1]);
+			tok.pos2 = field(m.pos[2]);
+			tok.pos3 = field(m.pos[3]);
+		}
+		else {
+			tok.form = field(m.pos[1]);
+			tok.type = field(m.pos[2]);
+			tok.form2 = field(m.pos[3]);
+		}
+		return;
+	}
+	tok.pos1 = field(m.pos[1]);
+	tok.pos2 = field(m.pos[2]);
+	tok.pos3 = field(m.pos[3]);
+	tok.type = field(m.conj_type);
+	tok.form = field(m.conj_form);
+	tok.orig = field(m.lemma);
+	tok.read = (m.reading == NULL) ? tok.surf : field(m.reading);
+	tok.pron = field(m.pron);
+}
+
+
+static bool make_sentence(const zunda_morph_t *morphs, size_t n_morphs, const int *heads, size_t n_chunks, int pos_tag, nlp::sentence &sent) {
+	if (n_morphs == 0 || n_chunks == 0 || morphs[0].chunk != 0) {
+		return false;
+	}
+	sent.ma_dic = (pos_tag == modality::POS_JUMAN) ? sent.JumanDic : sent.IPADic;
+	sent.da_tool = sent.CaboCha;
+	sent.chunks.resize(n_chunks);
+	for (size_t c=0 ; c<n_chunks ; ++c) {
+		if (heads[c] < -1 || heads[c] >= (int)n_chunks) {
+			return false;
+		}
+		sent.chunks[c].id = c;
+		sent.chunks[c].dst = heads[c];
+		sent.chunks[c].type = "D";
+	}
+	for (size_t i=0 ; i<n_morphs ; ++i) {
+		int c = morphs[i].chunk;
+		// chunks are in order and none is empty
+		if (i > 0 && c != morphs[i-1].chunk && c != morphs[i-1].chunk + 1) {
+			return false;
+		}
+		if (c < 0 || c >= (int)n_chunks) {
+			return false;
+		}
+		nlp::chunk &chk = sent.chunks[c];
+		nlp::token tok;
+		make_token(morphs[i], i, pos_tag, tok);
+		sent.t2c[tok.id] = c;
+		chk.tok_g2l[tok.id] = chk.tokens.size();
+		chk.tokens.push_back(tok);
+	}
+	if (morphs[n_morphs-1].chunk != (int)n_chunks-1) {
+		return false;
+	}
+	sent.tid_min = 0;
+	sent.tid_max = n_morphs-1;
+	sent.cid_min = 0;
+	sent.cid_max = n_chunks-1;
+	return true;
+}
+
+
+extern "C" {
+
+zunda_t *zunda_new(const char *model_dir, const char *dic_dir, int pos_tag) {
+	std::string model = (model_dir != NULL) ? model_dir : (pos_tag == ZUNDA_POS_JUMAN ? MODELDIR_JUMAN : MODELDIR_IPA);
+	std::string dic = (dic_dir != NULL) ? dic_dir : DICDIR;
+	if (pos_tag != ZUNDA_POS_IPA && pos_tag != ZUNDA_POS_JUMAN) {
+		std::cerr << "ERROR: no such pos tag" << std::endl;
+		return NULL;
+	}
+	// the constructor of the parser exits on a missing dictionary
+	const char *cdbs[2] = {"ttjcore2seq.cdb", "FAdic.cdb"};
+	for (unsigned int i=0 ; i<2 ; ++i) {
+		if (!boost::filesystem::exists(boost::filesystem::path(dic) / cdbs[i])) {
+			std::cerr << "ERROR: " << (boost::filesystem::path(dic) / cdbs[i]).string() << " not found" << std::endl;
+			return NULL;
+		}
+	}
+
+	zunda_t *z = new zunda_t;
+	z->pos_tag = pos_tag;
+	z->mod_parser = new modality::parser(model, dic);
+	if (!z->mod_parser->set_pos_tag(pos_tag, "") || !z->mod_parser->load_models()) {
+		delete z->mod_parser;
+		delete z;
+		return NULL;
+	}
+	z->mod_parser->f2i.set_concurrent(true);
+	z->mod_parser->i2l.set_concurrent(true);
+
+	nlp::modality defaults;
+	for (unsigned int t=0 ; t<ZUNDA_TAG_NUM ; ++t) {
+		z->labels.insert(defaults.get(t));
+	}
+	BOOST_FOREACH (unsigned int i, z->mod_parser->analyze_tags) {
+		const linear::model *m = z->mod_parser->models[i];
+		for (int k=0 ; k<m->nr_class ; ++k) {
+			std::string label;
+			if (z->mod_parser->i2l.get(m->label[k], &label)) {
+				z->labels.insert(label);
+			}
+		}
+	}
+	return z;
+}
+
+
+void zunda_destroy(zunda_t *z) {
+	if (z == NULL) {
+		return;
+	}
+	delete z->mod_parser;
+	delete z;
+}
+
+
+int zunda_analyze(zunda_t *z, const zunda_morph_t *morphs, size_t n_morphs, const int *heads, size_t n_chunks, zunda_event_t *events, size_t max_events) {
+	try {
+		nlp::sentence sent;
+		if (!make_sentence(morphs, n_morphs, heads, n_chunks, z->pos_tag, sent)) {
+			return -1;
+		}
+		if (!z->mod_parser->analyze(sent)) {
+			return -1;
+		}
+
+		size_t n_events = 0;
+		BOOST_FOREACH (nlp::chunk &chk, sent.chunks) {
+			BOOST_FOREACH (nlp::token &tok, chk.tokens) {
+				if (!tok.has_mod) {
+					continue;
+				}
+				if (n_events < max_events) {
+					zunda_event_t &ev = events[n_events];
+					ev.token = tok.id;
+					for (unsigned int t=0 ; t<ZUNDA_TAG_NUM ; ++t) {
+						ev.tags[t] = intern(z, tok.mod.get(t));
+					}
+				}
+				n_events++;
+			}
+		}
+		return n_events;
+	}
+	catch (...) {
+		return -1;
+	}
+}
+
+
+const char *zunda_tag_name(int tag) {
+	if (tag < 0 || tag >= ZUNDA_TAG_NUM) {
+		return NULL;
+	}
+	return nlp::modality::tag_name(tag).c_str();
+}
+
+}
@@ -5,20 +5,30 @@
 #include <boost/filesystem.hpp>
 #include "sentence.hpp"
 #include "modality.hpp"
+#include "writer.hpp"
 
 
 int main(int argc, char *argv[]) {
 	std::ios::sync_with_stdio(false);
 	std::cin.tie(0);
+	// counts allocations until the options tell whether --mem-stats is given
+	modality::mem_stats::enable();
 
 	boost::program_options::options_description opt("Usage", 200, 100);
 	opt.add_options()
 		("input,i", boost::program_options::value<int>(), "input layer (optional)\n 0 - raw text layer [default]\n 1 - dependency parsed layer by CaboCha/J.DepP\n 2 - dependency parsed layer by KNP\n 3 - predicate-argument structure analyzed layer by SynCha/ChaPAS\n 4 - predicate-argument structure analyzed layer by KNP")
 		("pos", boost::program_options::value<int>(), "POS tag for CaboCha/J.DepP (optional)\n 0 - IPA/Naist-jdic [default]\n 1 - JumanDic\n 2 - UniDic")
 		("posset", boost::program_options::value<std::string>(), "POS set to parse (optional")
-		("target,t", boost::program_options::value<unsigned int>(), "method of detecting token to be analyzed\n 0 - by part of speech [default]\n 1 - predicate detected by a predicate-argument structure analyzer (only SynCha format is supported)\n 2 - by machine learning (has not been implemented)")
+		("target,t", boost::program_options::value<unsigned int>(), "method of detecting token to be analyzed\n 0 - by part of speech [default]\n 1 - predicate detected by a predicate-argument structure analyzer (only SynCha format is supported)\n 2 - by machine learning: the tokens detected by part of speech that the target detector of the model (model_target) takes for events")
+		("target-threshold", boost::program_options::value<double>(), "probability of being an event from which a token is a target with --target 2 (optional): default 0.5; lower keeps more events, higher analyzes fewer tokens")
+		("cascade", boost::program_options::value<double>()->implicit_value(1.0), "run the fast models learned by zunda-train --cascade first, and the full model of a tag only when the margin of the fast one is below this (optional): default 1.0; see zunda-bench --cascade for accuracy and speed by margin")
+		("tags", boost::program_options::value<std::string>(), "tags to analyze, separated by commas (optional)\n tense, type, assumptional, authenticity, sentiment [default: all]\n the tags their features depend on are analyzed as well, and only the models of these tags are loaded")
 		("model,m", boost::program_options::value<std::string>(), "model directory (optional)")
 		("dic,d", boost::program_options::value<std::string>(), "dictionary directory (optional)")
+		("output", boost::program_options::value<std::string>(), "output format (optional)\n text - #EVENT lines followed by the input [default]\n jsonl - a JSON object per sentence\n binary - length-prefixed records with a label table (see writer.hpp)")
+		("scores", "also output the decision values of the predicted tags (jsonl and binary output only)")
+		("stats", boost::program_options::value<std::string>()->implicit_value("-"), "dump per-stage timers and counters as JSON to the file (default: stderr) at exit and on SIGUSR1 (optional)")
+		("mem-stats", boost::program_options::value<std::string>()->implicit_value("-"), "also count allocations per stage and report the memory footprint in the --stats JSON, written to the file (default: stderr) unless --stats is given (optional)")
 		("help,h", "Show help messages")
 		("version,v", "Show version information");
 
@@ -78,6 +88,18 @@ int main(int argc, char *argv[]) {
 		dic_dir = argmap["dic"].as<std::string>();
 	}
 
+	int output_format = modality::OUT_TEXT;
+	if (argmap.count("output")) {
+		if (!modality::result_writer::parse_format(argmap["output"].as<std::string>(), &output_format)) {
+			std::cerr << "ERROR: no such output format" << std::endl;
+			return -1;
+		}
+	}
+	if (argmap.count("scores") && output_format == modality::OUT_TEXT) {
+		std::cerr << "ERROR: --scores needs --output jsonl or binary" << std::endl;
+		return -1;
+	}
+
 	if (argmap.count("help")) {
 		std::cout << opt << std::endl;
 		return 1;
@@ -88,12 +110,47 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
+	if (!argmap.count("mem-stats")) {
+		modality::mem_stats::disable();
+	}
+	if (argmap.count("stats")) {
+		modality::stats::enable(argmap["stats"].as<std::string>());
+	}
+	else if (argmap.count("mem-stats")) {
+		modality::stats::enable(argmap["mem-stats"].as<std::string>());
+	}
+	int64_t live_before_parser = modality::mem_stats::live_bytes();
+
 	modality::parser mod_parser(model_dir, dic_dir);
-	mod_parser.set_pos_tag(pos_tag, pos_set);
+	if (!mod_parser.set_pos_tag(pos_tag, pos_set)) {
+		exit(-1);
+	}
 
 	if (argmap.count("target")) {
 		mod_parser.target_detection = argmap["target"].as<unsigned int>();
 	}
+	if (argmap.count("target-threshold")) {
+		mod_parser.target_threshold = argmap["target-threshold"].as<double>();
+		if (mod_parser.target_threshold < 0 || 1 < mod_parser.target_threshold) {
+			std::cerr << "ERROR: invalid target threshold" << std::endl;
+			return -1;
+		}
+	}
+
+	if (argmap.count("cascade")) {
+		mod_parser.cascade = true;
+		mod_parser.cascade_threshold = argmap["cascade"].as<double>();
+		if (mod_parser.cascade_threshold < 0) {
+			std::cerr << "ERROR: invalid cascade threshold" << std::endl;
+			return -1;
+		}
+	}
+
+	if (argmap.count("tags")) {
+		if (!mod_parser.set_analyze_tags(argmap["tags"].as<std::string>())) {
+			return -1;
+		}
+	}
 
 #ifdef _MODEBUG
 	clock_t st;
@@ -108,11 +165,17 @@ int main(int argc, char *argv[]) {
 	et = std::clock();
 	std::cerr << "* load model done: " << (et-st) / (double)CLOCKS_PER_SEC << " sec" << std::endl;
 #endif
+	if (modality::mem_stats::enabled()) {
+		modality::mem_stats::add_component("parser_heap", modality::mem_stats::live_bytes() - live_before_parser);
+		mod_parser.add_mem_components();
+	}
 
+	modality::result_writer writer(&mod_parser, &std::cout, output_format, argmap.count("scores"));
 	std::string buf;
 	std::string sent;
-	std::string parsed_sent;
 	bool run = false;
+	uint64_t st_input = modality::stats::now();
+	int prev_stage = modality::mem_stats::enter(modality::ST_INPUT);
 	while( getline(std::cin, buf) ) {
 		switch (input_layer) {
 			case modality::IN_RAW:
@@ -137,10 +200,20 @@ int main(int argc, char *argv[]) {
 		}
 		
 		if (run) {
-		 	mod_parser.analyzeToString(sent, input_layer, parsed_sent);
-			std::cout << parsed_sent << std::endl;
+			modality::stats::add_time(modality::ST_INPUT, st_input);
+			modality::mem_stats::leave(prev_stage);
+			nlp::sentence parsed_sent;
+			if (mod_parser.analyze(sent, input_layer, parsed_sent)) {
+				modality::stat_timer timer(modality::ST_OUTPUT);
+				writer.write(parsed_sent);
+			}
+			else {
+				writer.skip();
+			}
 			sent.clear();
 			run = false;
+			st_input = modality::stats::now();
+			prev_stage = modality::mem_stats::enter(modality::ST_INPUT);
 		}
 	}
 
@@ -0,0 +1,91 @@
+#include <new>
+#include <cstdlib>
+#include "mem_stats.hpp"
+
+/*
+ * Global operator new/delete counting allocations for --mem-stats; linked
+ * into zunda and zunda-train only. They fall through to malloc/free, so the
+ * only cost while mem_stats is disabled is the flag check.
+ */
+
+#if __cplusplus >= 201103L
+#define MEM_STATS_THROW_BAD_ALLOC
+#define MEM_STATS_NOTHROW noexcept
+#else
+#define MEM_STATS_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define MEM_STATS_NOTHROW throw()
+#endif
+
+
+static void *counted_alloc(size_t size) {
+	void *p = malloc(size == 0 ? 1 : size);
+	modality::mem_stats::on_alloc(p);
+	return p;
+}
+
+
+static void counted_free(void *p) {
+	modality::mem_stats::on_free(p);
+	free(p);
+}
+
+
+void *operator new(size_t size) MEM_STATS_THROW_BAD_ALLOC {
+	void *p = counted_alloc(size);
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+
+void *operator new[](size_t size) MEM_STATS_THROW_BAD_ALLOC {
+	void *p = counted_alloc(size);
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+
+void *operator new(size_t size, const std::nothrow_t &) MEM_STATS_NOTHROW {
+	return counted_alloc(size);
+}
+
+
+void *operator new[](size_t size, const std::nothrow_t &) MEM_STATS_NOTHROW {
+	return counted_alloc(size);
+}
+
+
+void operator delete(void *p) MEM_STATS_NOTHROW {
+	counted_free(p);
+}
+
+
+void operator delete[](void *p) MEM_STATS_NOTHROW {
+	counted_free(p);
+}
+
+
+void operator delete(void *p, const std::nothrow_t &) MEM_STATS_NOTHROW {
+	counted_free(p);
+}
+
+
+void operator delete[](void *p, const std::nothrow_t &) MEM_STATS_NOTHROW {
+	counted_free(p);
+}
+
+
+#ifdef __cpp_sized_deallocation
+// C++14 calls these when the size is known; they must count as the others do
+void operator delete(void *p, size_t) MEM_STATS_NOTHROW {
+	counted_free(p);
+}
+
+
+void operator delete[](void *p, size_t) MEM_STATS_NOTHROW {
+	counted_free(p);
+}
+#endif
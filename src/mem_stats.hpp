@@ -0,0 +1,226 @@
+#ifndef __MEM_STATS_HPP__
+#define __MEM_STATS_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <stdint.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <boost/thread.hpp>
+
+namespace modality {
+	/*
+	 * Allocations counted by the global operator new/delete of mem_stats.cpp
+	 * (--mem-stats). An allocation is charged to the stage of the innermost
+	 * stat_timer of its thread, or to "other" outside of any stage; sizes are
+	 * the usable sizes of malloc so that a block is counted with the same
+	 * size when it is freed. Counters are updated with atomic adds and
+	 * nothing here allocates on the counting path.
+	 */
+	class mem_stats {
+		public:
+			// stat_timer stages and "other"
+			static const unsigned int MAX_STAGES = 32;
+
+			typedef struct {
+				size_t sents;
+				size_t entries[3];
+				size_t bytes[3];
+			} t_memo_sample;
+
+			static bool enabled() {
+				return enabled_flag();
+			}
+
+			// called first thing in main, before the options are parsed, so that
+			// a block freed later was counted when it was allocated (only blocks
+			// of static initialization are not); disable() if --mem-stats is not
+			// given. Also before stats::enable(), so that these are destroyed
+			// after its dump at exit
+			static void enable() {
+				mtx();
+				components();
+				samples();
+				enabled_flag() = true;
+			}
+
+			static void disable() {
+				enabled_flag() = false;
+			}
+
+			// returns the stage to restore with leave()
+			static int enter(int stage) {
+				if (!enabled()) {
+					return -1;
+				}
+				int prev = current_stage();
+				current_stage() = stage;
+				return prev;
+			}
+
+			static void leave(int prev) {
+				if (!enabled()) {
+					return;
+				}
+				current_stage() = prev;
+			}
+
+			static void on_alloc(void *p) {
+				if (!enabled() || p == NULL) {
+					return;
+				}
+				unsigned int s = slot();
+				__sync_fetch_and_add(&allocs()[s], (uint64_t)1);
+				__sync_fetch_and_add(&bytes_allocated()[s], (uint64_t)malloc_usable_size(p));
+			}
+
+			static void on_free(void *p) {
+				if (!enabled() || p == NULL) {
+					return;
+				}
+				unsigned int s = slot();
+				__sync_fetch_and_add(&frees()[s], (uint64_t)1);
+				__sync_fetch_and_add(&bytes_freed()[s], (uint64_t)malloc_usable_size(p));
+			}
+
+			// bytes allocated and not freed since enable()
+			static int64_t live_bytes() {
+				int64_t live = 0;
+				for (unsigned int s=0 ; s<MAX_STAGES ; ++s) {
+					live += bytes_allocated()[s] - bytes_freed()[s];
+				}
+				return live;
+			}
+
+			static size_t rss_bytes() {
+				std::ifstream ifs("/proc/self/statm");
+				size_t pages_total = 0, pages_resident = 0;
+				ifs >> pages_total >> pages_resident;
+				return pages_resident * sysconf(_SC_PAGESIZE);
+			}
+
+			// static footprint of a component loaded at startup
+			static void add_component(const std::string &name, int64_t bytes) {
+				boost::mutex::scoped_lock lock(mtx());
+				components().push_back(std::make_pair(name, bytes));
+			}
+
+			/*
+			 * sizes of the memo maps of CdbMap (feat2id, label2id, id2label)
+			 * after n sentences; taken at 1, 2, 4, 8, ... and every 1024
+			 * sentences, and only the powers of two and the latest one are kept
+			 * so that the series stays short on long runs
+			 */
+			static size_t count_sentence() {
+				return __sync_add_and_fetch(&sentences(), (size_t)1);
+			}
+
+			static bool want_sample(size_t n) {
+				return enabled() && n > 0 && ((n & (n-1)) == 0 || n % 1024 == 0);
+			}
+
+			static void add_sample(const t_memo_sample &sample) {
+				boost::mutex::scoped_lock lock(mtx());
+				std::vector< t_memo_sample > &series = samples();
+				if (!series.empty() && (series.back().sents & (series.back().sents-1)) != 0) {
+					series.pop_back();
+				}
+				series.push_back(sample);
+			}
+
+			static void dump(std::ostream &os, const char **stage_names, unsigned int n_stages, uint64_t sents) {
+				uint64_t total_allocs = 0;
+				os << "  \"memory\": {\n";
+				os << "    \"stages\": {\n";
+				for (unsigned int s=0 ; s<=n_stages ; ++s) {
+					unsigned int i = (s < n_stages) ? s : MAX_STAGES-1;
+					os << "      \"" << (s < n_stages ? stage_names[s] : "other") << "\": {\"allocs\": " << allocs()[i] << ", \"frees\": " << frees()[i] << ", \"bytes_allocated\": " << bytes_allocated()[i] << ", \"bytes_freed\": " << bytes_freed()[i] << "}";
+					os << (s < n_stages ? ",\n" : "\n");
+					total_allocs += allocs()[i];
+				}
+				os << "    },\n";
+				os << "    \"allocs_per_sentence\": " << (sents ? (double)total_allocs / sents : 0.0) << ",\n";
+				os << "    \"live_bytes\": " << live_bytes() << ",\n";
+				os << "    \"rss_bytes\": " << rss_bytes() << ",\n";
+
+				boost::mutex::scoped_lock lock(mtx());
+				os << "    \"components\": {\n";
+				for (size_t i=0 ; i<components().size() ; ++i) {
+					os << "      \"" << components()[i].first << "\": " << components()[i].second;
+					os << (i+1 < components().size() ? ",\n" : "\n");
+				}
+				os << "    },\n";
+				const char *maps[3] = {"feat2id", "label2id", "id2label"};
+				os << "    \"memo_maps\": [\n";
+				for (size_t i=0 ; i<samples().size() ; ++i) {
+					const t_memo_sample &sample = samples()[i];
+					os << "      {\"sents\": " << sample.sents;
+					for (unsigned int m=0 ; m<3 ; ++m) {
+						os << ", \"" << maps[m] << "\": {\"entries\": " << sample.entries[m] << ", \"bytes\": " << sample.bytes[m] << "}";
+					}
+					os << "}" << (i+1 < samples().size() ? ",\n" : "\n");
+				}
+				os << "    ]\n";
+				os << "  },\n";
+			}
+
+		private:
+			static bool &enabled_flag() {
+				static bool flag = false;
+				return flag;
+			}
+
+			static int &current_stage() {
+				static __thread int stage = -1;
+				return stage;
+			}
+
+			static unsigned int slot() {
+				int stage = current_stage();
+				return (stage < 0 || stage >= (int)MAX_STAGES-1) ? MAX_STAGES-1 : stage;
+			}
+
+			// zero-initialized, so that they can be used before main()
+			static uint64_t *allocs() {
+				static uint64_t v[MAX_STAGES];
+				return v;
+			}
+			static uint64_t *frees() {
+				static uint64_t v[MAX_STAGES];
+				return v;
+			}
+			static uint64_t *bytes_allocated() {
+				static uint64_t v[MAX_STAGES];
+				return v;
+			}
+			static uint64_t *bytes_freed() {
+				static uint64_t v[MAX_STAGES];
+				return v;
+			}
+
+			static size_t &sentences() {
+				static size_t n = 0;
+				return n;
+			}
+
+			static boost::mutex &mtx() {
+				static boost::mutex m;
+				return m;
+			}
+
+			static std::vector< std::pair<std::string, int64_t> > &components() {
+				static std::vector< std::pair<std::string, int64_t> > v;
+				return v;
+			}
+
+			static std::vector< t_memo_sample > &samples() {
+				static std::vector< t_memo_sample > v;
+				return v;
+			}
+	};
+};
+
+#endif
@@ -3,9 +3,13 @@
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
 #include "sentence.hpp"
 #include "modality.hpp"
 #include "eval.hpp"
+#include "param_search.hpp"
 
 
 bool mkdir(const boost::filesystem::path &dir_path) {
@@ -21,7 +25,278 @@ bool mkdir(const boost::filesystem::path &dir_path) {
 }
 
 
+/*
+ * One fold of cross validation. Each fold owns its parser (feature and label
+ * maps, models) and writes everything to its own directory, so that folds can
+ * run concurrently.
+ */
+class cross_fold {
+	public:
+		unsigned int step;
+		boost::filesystem::path fold_path;
+		evaluator evals[LABEL_NUM];
+		std::string log;
+};
+
+
+class cross_validator {
+	public:
+		// shared by the folds, which only read it
+		std::vector< nlp::sentence > *data;
+		// [begin, end) of each group in data
+		std::vector< std::pair<unsigned int, unsigned int> > groups;
+		std::vector< cross_fold > folds;
+
+		std::string dic_dir;
+		int pos_tag;
+		std::string pos_set;
+		unsigned int target_detection;
+		int train_threads;
+		int feature_hash_bits;
+
+	private:
+		unsigned int next_step;
+		boost::mutex mtx;
+
+	public:
+		cross_validator(std::vector< nlp::sentence > *_data, unsigned int split_num, const boost::filesystem::path &outdir_path) {
+			data = _data;
+			unsigned int grp_size = data->size() / split_num;
+			for (unsigned int i=0 ; i<split_num ; ++i) {
+				// last group = rest of learning data
+				unsigned int end = (i+1 == split_num) ? data->size() : (i+1)*grp_size;
+				groups.push_back(std::make_pair(i*grp_size, end));
+
+				cross_fold fold;
+				fold.step = i;
+				std::stringstream suffix_ss;
+				suffix_ss << "fold" << std::setw(3) << std::setfill('0') << i;
+				fold.fold_path = outdir_path / boost::filesystem::path(suffix_ss.str());
+				folds.push_back(fold);
+			}
+			next_step = 0;
+			pos_tag = modality::POS_IPA;
+			target_detection = modality::DETECT_BY_POS;
+			train_threads = 1;
+			feature_hash_bits = 0;
+		}
+
+		void run(unsigned int jobs) {
+			next_step = 0;
+			if (jobs > folds.size()) {
+				jobs = folds.size();
+			}
+			boost::thread_group workers;
+			for (unsigned int i=0 ; i<jobs ; ++i) {
+				workers.create_thread( boost::bind(&cross_validator::worker, this) );
+			}
+			workers.join_all();
+		}
+
+		// merge per-fold results in fold order, so that the tables do not depend on scheduling
+		void merge(evaluator *evals) {
+			BOOST_FOREACH (cross_fold &fold, folds) {
+				for (unsigned int i=0 ; i<LABEL_NUM ; ++i) {
+					evals[i].merge(fold.evals[i]);
+				}
+			}
+		}
+
+	private:
+		void worker() {
+			while (true) {
+				unsigned int step;
+				{
+					boost::mutex::scoped_lock lock(mtx);
+					if (next_step >= folds.size()) {
+						return;
+					}
+					step = next_step++;
+				}
+				run_fold(folds[step]);
+				boost::mutex::scoped_lock lock(mtx);
+				std::cout << folds[step].log << std::flush;
+			}
+		}
+
+		void run_fold(cross_fold &fold) {
+			std::stringstream log_ss;
+			log_ss << "* step " << fold.step << std::endl;
+			mkdir(fold.fold_path);
+
+			modality::parser mod_parser(fold.fold_path.string(), dic_dir);
+			// pos_set has been compiled once by main
+			mod_parser.set_pos_tag(pos_tag, pos_set);
+			mod_parser.target_detection = target_detection;
+			mod_parser.train_threads = train_threads;
+			mod_parser.feature_hash_bits = feature_hash_bits;
+
+			boost::filesystem::path result_path[LABEL_NUM];
+			BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
+				boost::filesystem::path rp("result_" + mod_parser.id2tag(i));
+				result_path[i] = fold.fold_path / rp;
+			}
+
+			for (unsigned int i=0 ; i<groups.size() ; ++i) {
+				if (i != fold.step) {
+					// set learning data. used No.step data set as test data
+					for (unsigned int k=groups[i].first ; k<groups[i].second ; ++k) {
+						mod_parser.learning_refs.push_back(&(*data)[k]);
+					}
+				}
+			}
+			log_ss << " learning data size: " << mod_parser.learning_refs.size() << std::endl;
+
+			mod_parser.learn();
+			mod_parser.learning_refs.clear();
+			mod_parser.load_models();
+
+			std::ofstream os[LABEL_NUM];
+			BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
+				os[i].open(result_path[i].string().c_str());
+			}
+
+			// events of the test data, targets detected and both, for DETECT_BY_ML
+			unsigned int cnt_event = 0, cnt_target = 0, cnt_hit = 0;
+			for (unsigned int sent_cnt=groups[fold.step].first ; sent_cnt<groups[fold.step].second ; ++sent_cnt) {
+				const nlp::sentence &gold_sent = (*data)[sent_cnt];
+				nlp::sentence test_sent = gold_sent;
+#ifdef _MODEBUG
+				log_ss << "before " << test_sent.sent_id << ": ";
+				BOOST_FOREACH (nlp::chunk chk, test_sent.chunks) {
+					BOOST_FOREACH (nlp::token tok, chk.tokens) {
+						if (tok.has_mod) {
+							std::string mod_str;
+							tok.mod.str(mod_str);
+							log_ss << "  " << mod_str << std::endl;
+						}
+					}
+				}
+#endif
+
+				// when target detection is DETECT_BY_GOLD, only bool value of having modality is set to test data
+				if (mod_parser.target_detection == modality::DETECT_BY_GOLD) {
+					BOOST_FOREACH (nlp::chunk chk, test_sent.chunks) {
+						BOOST_FOREACH (nlp::token tok, chk.tokens) {
+							if (tok.has_mod) {
+								tok.mod.clear();
+							}
+						}
+					}
+				}
+				else {
+					test_sent.clear_mod();
+				}
+
+				// tokens to be analyzed are detected by specified method in analyze() and gold data validation
+				mod_parser.analyze(test_sent);
+
+#ifdef _MODEBUG
+				log_ss << "after  " << test_sent.sent_id << ": ";
+				BOOST_FOREACH (nlp::chunk chk, test_sent.chunks) {
+					BOOST_FOREACH (nlp::token tok, chk.tokens) {
+						if (tok.has_mod) {
+							std::string mod_str;
+							tok.mod.str(mod_str);
+							log_ss << "  " << mod_str << std::endl;
+						}
+					}
+				}
+#endif
+
+				for (unsigned int chk_cnt=0 ; chk_cnt<test_sent.chunks.size() ; ++chk_cnt) {
+					for (unsigned int tok_cnt=0 ; tok_cnt<test_sent.chunks[chk_cnt].tokens.size() ; ++tok_cnt) {
+						nlp::token tok_gold = gold_sent.chunks[chk_cnt].tokens[tok_cnt];
+						nlp::token &tok_sys = test_sent.chunks[chk_cnt].tokens[tok_cnt];
+						cnt_event += tok_gold.has_mod;
+						cnt_target += tok_sys.has_mod;
+						cnt_hit += tok_gold.has_mod && tok_sys.has_mod;
+						if (tok_gold.has_mod && tok_sys.has_mod) {
+							std::stringstream id_ss;
+							id_ss << test_sent.sent_id << "_" << tok_sys.id;
+
+							BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
+								fold.evals[i].add( id_ss.str() , tok_gold.mod.get(i), tok_sys.mod.get(i) );
+								os[i] << id_ss.str() << "," << tok_gold.mod.get(i) << "," << tok_sys.mod.get(i) << std::endl;
+							}
+						}
+						else if (tok_sys.has_mod && !tok_gold.has_mod) {
+							std::cerr << "ERROR: modality tag does not exist in token " << tok_sys.id << " in " << test_sent.sent_id << std::endl;
+						}
+					}
+				}
+			}
+
+			BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
+				os[i].close();
+			}
+			if (mod_parser.target_detection == modality::DETECT_BY_ML) {
+				log_ss << " target detection: " << cnt_hit << " of " << cnt_event << " events in " << cnt_target << " targets" << std::endl;
+			}
+
+			mod_parser.save_f2i();
+			mod_parser.save_l2i();
+			mod_parser.save_i2l();
+
+			fold.log = log_ss.str();
+		}
+};
+
+
+/*
+ * print how many tagged morphemes of XML input were not aligned to parsed
+ * tokens, and list their morphIDs in outdir/unmatched_morphids
+ */
+void report_alignment(modality::parser &mod_parser, const boost::filesystem::path &outdir_path) {
+	modality::t_align_stats &stats = mod_parser.align_stats;
+	if (stats.events == 0) {
+		return;
+	}
+	std::cout << "   " << stats.events << " tagged morphemes, " << stats.unmatched << " not aligned" << std::endl;
+	if (stats.unmatched > 0) {
+		boost::filesystem::path unmatched_path = outdir_path / "unmatched_morphids";
+		std::ofstream ofs(unmatched_path.string().c_str());
+		sort(stats.unmatched_morph_ids.begin(), stats.unmatched_morph_ids.end());
+		BOOST_FOREACH (const std::string &morph_id, stats.unmatched_morph_ids) {
+			ofs << morph_id << std::endl;
+		}
+	}
+}
+
+
+/*
+ * search solver and C of each tag by cross validation on the feature matrices,
+ * and record the results in outdir/hyperparams
+ */
+void search_hyperparams(modality::parser &mod_parser, modality::feature_matrix *matrices, modality::param_search &searcher, unsigned int jobs, const boost::filesystem::path &outdir_path) {
+	modality::t_hyperparam best[LABEL_NUM];
+	searcher.train_threads = mod_parser.train_threads;
+	searcher.run(matrices, mod_parser.feature_dim(), mod_parser.analyze_tags, jobs, best);
+
+	boost::filesystem::path hp_path = outdir_path / "hyperparams";
+	std::ofstream ofs(hp_path.string().c_str());
+	if (!ofs) {
+		std::cerr << "ERROR: cannot write " << hp_path.string() << std::endl;
+		exit(-1);
+	}
+	BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
+		std::cout << "* " << mod_parser.id2tag(i) << std::endl;
+		BOOST_FOREACH (const modality::t_hyperparam &hp, searcher.scores[i]) {
+			std::cout << " solver " << hp.solver_type << "\tC " << hp.C << "\t" << hp.accuracy << std::endl;
+		}
+		std::cout << " best: solver " << best[i].solver_type << "\tC " << best[i].C << std::endl;
+		ofs << mod_parser.id2tag(i) << "\t" << best[i].solver_type << "\t" << best[i].C << "\t" << best[i].accuracy << std::endl;
+
+		mod_parser.solver_type[i] = best[i].solver_type;
+		mod_parser.cost[i] = best[i].C;
+	}
+	std::cout << std::endl;
+}
+
+
 int main(int argc, char *argv[]) {
+	// counts allocations until the options tell whether --mem-stats is given
+	modality::mem_stats::enable();
 
 	unsigned int split_num = 5;
 
@@ -33,10 +308,23 @@ int main(int argc, char *argv[]) {
 		("pos", boost::program_options::value<int>(), "POS tag for CaboCha/J.DepP (optional)\n 0 - IPA/Naist-jdic [default]\n 1 - JumanDic\n 2 - UniDic")
 		("posset", boost::program_options::value<std::string>(), "POS set to parse (optional")
 		("cross,x", "enable cross validation (optional): default off")
-		("split,g", boost::program_options::value<unsigned int>(), "number of groups for cross validation (optional): default 5")
+		("split,g", boost::program_options::value<unsigned int>(), "number of groups for cross validation and --search (optional): default 5")
+		("train-threads", boost::program_options::value<int>(), "number of threads used to train each model (optional): default 1")
+		("jobs,j", boost::program_options::value<unsigned int>(), "number of input loaders, cross validation folds, search jobs or juman/knp processes run in parallel (optional): default number of CPU cores")
+		("knp-command", boost::program_options::value<std::string>(), "command to parse a sentence per line for KNP input formats (optional): default \"juman | knp -tab\"")
 		("outdir,o", boost::program_options::value<std::string>(), "directory to store output files (optional)\n simple training -  stores model file and feature file to \"model (default)\"\n cross validation - stores model file, feature file and result file to \"output (default)\"")
 		("dic,d", boost::program_options::value<std::string>(), "dictionary directory (optional)")
-		("target,t", boost::program_options::value<unsigned int>(), "method of detecting token to be learned\n 0 - by part of speech [default]\n 1 - predicate detected by a predicate-argument structure analyzer (only SynCha format is supported)\n 2 - by machine learning (has not been implemented)\n 3 - by gold data")
+		("target,t", boost::program_options::value<unsigned int>(), "method of detecting token to be learned\n 0 - by part of speech [default]\n 1 - predicate detected by a predicate-argument structure analyzer (only SynCha format is supported)\n 2 - by machine learning: as 0, and the target detector (model_target) is learned from the tokens detected by part of speech, events of the input data being positive\n 3 - by gold data")
+		("search", "search liblinear solver and C of each tag by cross validation before training, and write them to outdir/hyperparams (optional): default off")
+		("search-c", boost::program_options::value<std::string>(), "comma-separated costs to search (optional): default 0.0625,0.25,1,4,16")
+		("search-solver", boost::program_options::value<std::string>(), "comma-separated liblinear solver types to search (optional): default 0,2")
+		("cascade", "also learn the fast models of the cascade (model_<tag>_fast) from the tok, func_surf and mod_type features, which zunda --cascade runs before the full models (optional): default off")
+		("feature-hash", boost::program_options::value<int>()->implicit_value(18), "map features into 2^k buckets by their MurmurHash2 instead of learning the feature dictionary (feat2id.cdb), which zunda then does without; k is stored in outdir/feature_hash (optional): default off, k = 18 when not given; --from-features takes k from the dumped features")
+		("stream", "convert input data to feature rows while loading and train from the rows spilled to outdir, without keeping the input data in memory (optional): default off")
+		("dump-features", boost::program_options::value<std::string>(), "directory to store extracted feature matrices and maps for --from-features (optional)")
+		("from-features", boost::program_options::value<std::string>(), "learn from feature matrices stored by --dump-features instead of input data (optional)")
+		("stats", boost::program_options::value<std::string>()->implicit_value("-"), "dump per-stage timers and counters as JSON to the file (default: stderr) at exit and on SIGUSR1 (optional)")
+		("mem-stats", boost::program_options::value<std::string>()->implicit_value("-"), "also count allocations per stage and report the memory footprint in the --stats JSON, written to the file (default: stderr) unless --stats is given (optional)")
 		("help,h", "Show help messages")
 		("version,v", "Show version informaion");
 
@@ -89,6 +377,147 @@ int main(int argc, char *argv[]) {
 		pos_set = argmap["posset"].as<std::string>();
 	}
 
+	if (!argmap.count("mem-stats")) {
+		modality::mem_stats::disable();
+	}
+	if (argmap.count("stats")) {
+		modality::stats::enable(argmap["stats"].as<std::string>());
+	}
+	else if (argmap.count("mem-stats")) {
+		modality::stats::enable(argmap["mem-stats"].as<std::string>());
+	}
+
+	modality::parser mod_parser(outdir_path.string(), dic_dir);
+	if (!mod_parser.set_pos_tag(pos_tag, pos_set)) {
+		exit(-1);
+	}
+	if (modality::mem_stats::enabled()) {
+		mod_parser.add_mem_components();
+	}
+
+	if (argmap.count("target")) {
+		mod_parser.target_detection = argmap["target"].as<unsigned int>();
+	}
+
+	if (argmap.count("train-threads")) {
+		mod_parser.train_threads = argmap["train-threads"].as<int>();
+		if (mod_parser.train_threads < 1) {
+			std::cerr << "ERROR: invalid number of training threads" << std::endl;
+			exit(-1);
+		}
+	}
+
+	if (argmap.count("split")) {
+		split_num = argmap["split"].as<unsigned int>();
+	}
+	unsigned int jobs = boost::thread::hardware_concurrency();
+	if (argmap.count("jobs")) {
+		jobs = argmap["jobs"].as<unsigned int>();
+	}
+	if (jobs == 0) {
+		jobs = 1;
+	}
+	mod_parser.load_threads = jobs;
+	mod_parser.knp_workers = jobs;
+	if (argmap.count("knp-command")) {
+		mod_parser.knp_command = argmap["knp-command"].as<std::string>();
+	}
+
+	// a feature_hash left in outdir by an earlier training is not followed
+	mod_parser.feature_hash_bits = 0;
+	if (argmap.count("feature-hash")) {
+		mod_parser.feature_hash_bits = argmap["feature-hash"].as<int>();
+		if (mod_parser.feature_hash_bits < 1 || modality::parser::FEATURE_HASH_MAX_BITS < mod_parser.feature_hash_bits) {
+			std::cerr << "ERROR: --feature-hash takes 1 to " << modality::parser::FEATURE_HASH_MAX_BITS << " bits" << std::endl;
+			exit(-1);
+		}
+	}
+
+	if (argmap.count("cascade")) {
+		if (argmap.count("cross") || argmap.count("from-features")) {
+			std::cerr << "ERROR: --cascade cannot be used with cross validation or --from-features" << std::endl;
+			exit(-1);
+		}
+		mod_parser.cascade = true;
+	}
+
+	modality::param_search searcher;
+	searcher.split_num = split_num;
+	if (argmap.count("search")) {
+		if (argmap.count("cross")) {
+			std::cerr << "ERROR: --search cannot be used with cross validation" << std::endl;
+			exit(-1);
+		}
+		std::vector<std::string> vals;
+		if (argmap.count("search-c")) {
+			boost::algorithm::split(vals, argmap["search-c"].as<std::string>(), boost::algorithm::is_any_of(","));
+			searcher.costs.clear();
+			BOOST_FOREACH (const std::string &val, vals) {
+				try {
+					searcher.costs.push_back( boost::lexical_cast<double>(val) );
+				}
+				catch (const boost::bad_lexical_cast &) {
+					std::cerr << "ERROR: invalid cost " << val << std::endl;
+					exit(-1);
+				}
+			}
+			// warm starts go from small C to large C
+			sort(searcher.costs.begin(), searcher.costs.end());
+		}
+		if (argmap.count("search-solver")) {
+			boost::algorithm::split(vals, argmap["search-solver"].as<std::string>(), boost::algorithm::is_any_of(","));
+			searcher.solvers.clear();
+			BOOST_FOREACH (const std::string &val, vals) {
+				try {
+					searcher.solvers.push_back( boost::lexical_cast<int>(val) );
+				}
+				catch (const boost::bad_lexical_cast &) {
+					std::cerr << "ERROR: invalid solver type " << val << std::endl;
+					exit(-1);
+				}
+			}
+		}
+		modality::t_hyperparam rejected;
+		const char *error = searcher.check_parameters(&rejected);
+		if (error != NULL) {
+			std::cerr << "ERROR: solver " << rejected.solver_type << " with C = " << rejected.C << ": " << error << std::endl;
+			exit(-1);
+		}
+		if (split_num < 2) {
+			std::cerr << "ERROR: --search needs 2 or more groups" << std::endl;
+			exit(-1);
+		}
+	}
+
+	if (argmap.count("from-features")) {
+		if (argmap.count("cross")) {
+			std::cerr << "ERROR: cross validation needs input data, not feature matrices" << std::endl;
+			exit(-1);
+		}
+		if (mod_parser.target_detection == modality::DETECT_BY_ML) {
+			std::cerr << "ERROR: the target detector is learned from input data, not feature matrices" << std::endl;
+			exit(-1);
+		}
+		boost::filesystem::path feat_dir_path(argmap["from-features"].as<std::string>());
+		modality::feature_matrix matrices[LABEL_NUM];
+		if (!mod_parser.load_features(feat_dir_path, matrices) || !mod_parser.check_feature_ids(matrices)) {
+			exit(-1);
+		}
+		std::cout << "load done" << std::endl;
+		std::cout << "   " << mod_parser.f2i.size() << " features" << std::endl;
+		std::cout << std::endl;
+
+		if (argmap.count("search")) {
+			search_hyperparams(mod_parser, matrices, searcher, jobs, outdir_path);
+		}
+		mod_parser.train_models(matrices);
+
+		mod_parser.save_f2i();
+		mod_parser.save_l2i();
+		mod_parser.save_i2l();
+		return 1;
+	}
+
 	if (!argmap.count("path") && !argmap.count("list")) {
 		std::cerr << "ERROR: no input data" << std::endl;
 		return false;
@@ -119,11 +548,22 @@ int main(int argc, char *argv[]) {
 		exit(-1);
 	}
 
-	modality::parser mod_parser(outdir_path.string(), dic_dir);
-	mod_parser.set_pos_tag(pos_tag, pos_set);
+	if (argmap.count("stream")) {
+		if (argmap.count("cross") || argmap.count("search") || argmap.count("dump-features")) {
+			std::cerr << "ERROR: --stream cannot be used with cross validation, --search or --dump-features" << std::endl;
+			exit(-1);
+		}
+		if (input_layer < modality::IN_DEP_CAB || modality::IN_XML_KNP < input_layer) {
+			std::cerr << "ERROR: invalid input format" << std::endl;
+			exit(-1);
+		}
+		mod_parser.learn_stream(files, input_layer, outdir_path);
+		report_alignment(mod_parser, outdir_path);
 
-	if (argmap.count("target")) {
-		mod_parser.target_detection = argmap["target"].as<unsigned int>();
+		mod_parser.save_f2i();
+		mod_parser.save_l2i();
+		mod_parser.save_i2l();
+		return 1;
 	}
 
 	switch (input_layer) {
@@ -143,9 +583,9 @@ int main(int argc, char *argv[]) {
 	}
 
 	unsigned int cnt_inst = 0;
-	BOOST_FOREACH (nlp::sentence sent, mod_parser.learning_data) {
-		BOOST_FOREACH (nlp::chunk chk, sent.chunks) {
-			BOOST_FOREACH (nlp::token tok, chk.tokens) {
+	BOOST_FOREACH (const nlp::sentence &sent, mod_parser.learning_data) {
+		BOOST_FOREACH (const nlp::chunk &chk, sent.chunks) {
+			BOOST_FOREACH (const nlp::token &tok, chk.tokens) {
 				if (tok.has_mod) {
 					cnt_inst++;
 				}
@@ -155,148 +595,41 @@ int main(int argc, char *argv[]) {
 	std::cout << "load done" << std::endl;
  	std::cout << "   " << mod_parser.learning_data.size() << " sents" << std::endl;
  	std::cout << "   " << cnt_inst << " instances" << std::endl;
+	report_alignment(mod_parser, outdir_path);
 	std::cout << std::endl;
 
 
-	if (argmap.count("cross")) {
-		evaluator evals[LABEL_NUM];
-	
-		if (argmap.count("x")) {
-			split_num = argmap["x"].as<unsigned int>();
-		}
-		unsigned int grp_size = mod_parser.learning_data.size() / split_num;
-		std::vector< std::vector< nlp::sentence > > split_data;
-
-		for (unsigned int i=0 ; i<split_num ; ++i) {
-			std::vector< nlp::sentence > grp;
-			// last group = rest of learning data
-			if (i+1 == split_num) {
-				std::copy(mod_parser.learning_data.begin() + i*grp_size, mod_parser.learning_data.end(), std::back_inserter(grp));
-			}
-			// divided data by split_num
-			else {
-				std::copy(mod_parser.learning_data.begin() + i*grp_size, mod_parser.learning_data.begin() + (i+1)*grp_size, std::back_inserter(grp));
-			}
-			split_data.push_back(grp);
+	// features of the whole input data, stored for --from-features
+	modality::feature_matrix matrices[LABEL_NUM];
+	modality::feature_matrix fast_matrices[LABEL_NUM];
+	modality::feature_matrix *fast = mod_parser.cascade ? fast_matrices : NULL;
+	if (argmap.count("dump-features")) {
+		boost::filesystem::path feat_dir_path(argmap["dump-features"].as<std::string>());
+		mkdir(feat_dir_path);
+		mod_parser.extract_features(matrices, fast);
+		if (!mod_parser.save_features(feat_dir_path, matrices)) {
+			exit(-1);
 		}
-		// split_data contains split_num data sets
+	}
 
-		unsigned int cnt = 0;
-		BOOST_FOREACH (std::vector<nlp::sentence> grp, split_data) {
-			std::cout << " group " << cnt << ": " << grp.size() << std::endl;
-			cnt++;
+	if (argmap.count("cross")) {
+		cross_validator validator(&mod_parser.learning_data, split_num, outdir_path);
+		validator.dic_dir = dic_dir;
+		validator.pos_tag = pos_tag;
+		validator.pos_set = pos_set;
+		validator.target_detection = mod_parser.target_detection;
+		validator.train_threads = mod_parser.train_threads;
+		validator.feature_hash_bits = mod_parser.feature_hash_bits;
+
+		for (unsigned int i=0 ; i<validator.groups.size() ; ++i) {
+			std::cout << " group " << i << ": " << validator.groups[i].second - validator.groups[i].first << std::endl;
 		}
 		std::cout << std::endl;
-		
-		for (unsigned int step=0 ; step<split_num ; ++step) {
-			std::cout << "* step " << step << std::endl;
-			mod_parser.learning_data.clear();
-
-			boost::filesystem::path model_path[LABEL_NUM];
-			boost::filesystem::path feat_path[LABEL_NUM];
-			boost::filesystem::path result_path[LABEL_NUM];
-
-			BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
-				std::stringstream suffix_ss;
-				suffix_ss << std::setw(3) << std::setfill('0') << step;
-				boost::filesystem::path mp("model_" + mod_parser.id2tag(i) + suffix_ss.str());
-				model_path[i] = outdir_path / mp;
-				boost::filesystem::path fp("feat_" + mod_parser.id2tag(i) + suffix_ss.str());
-				feat_path[i] = outdir_path / fp;
-				boost::filesystem::path rp("result_" + mod_parser.id2tag(i) + suffix_ss.str());
-				result_path[i] = outdir_path / rp;
-			}
-			
-			for (unsigned int i=0 ; i<split_num ; ++i) {
-				if (i != step) {
-					// set learning data. used No.step data set as test data
-					mod_parser.learning_data.insert(mod_parser.learning_data.end(), split_data[i].begin(), split_data[i].end());
-				}
-			}
-			std::cout << " learning data size: " << mod_parser.learning_data.size() << std::endl;
 
-			mod_parser.learn(model_path, feat_path);
+		validator.run(jobs);
 
-			mod_parser.load_models(model_path);
-
-			std::ofstream *os = new std::ofstream[LABEL_NUM];
-			BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
-				os[i].open(result_path[i].string().c_str());
-			}
-
-			std::vector< nlp::sentence > test_data;
-			BOOST_FOREACH (nlp::sentence sent, split_data[step]) {
-				test_data.push_back(sent);
-			}
-
-			for (unsigned int test_cnt=0 ; test_cnt<test_data.size() ; ++test_cnt) {
-#ifdef _MODEBUG
-				std::cout << "before " << test_data[test_cnt].sent_id << ": ";
-				BOOST_FOREACH (nlp::chunk chk, test_data[test_cnt].chunks) {
-					BOOST_FOREACH (nlp::token tok, chk.tokens) {
-						if (tok.has_mod) {
-							std::string mod_str;
-							tok.mod.str(mod_str);
-							std::cout << "  " << mod_str << std::endl;
-						}
-					}
-				}
-#endif
-
-				// when target detection is DETECT_BY_GOLD, only bool value of having modality is set to test data
-				if (mod_parser.target_detection == modality::DETECT_BY_GOLD) {
-					BOOST_FOREACH (nlp::chunk chk, test_data[test_cnt].chunks) {
-						BOOST_FOREACH (nlp::token tok, chk.tokens) {
-							if (tok.has_mod) {
-								tok.mod.tag.clear();
-							}
-						}
-					}
-				}
-				else {
-					test_data[test_cnt].clear_mod();
-				}
-
-				// tokens to be analyzed are detected by specified method in analyze() and gold data validation
-				mod_parser.analyze(test_data[test_cnt]);
-
-#ifdef _MODEBUG
-				std::cout << "after  " << test_data[test_cnt].sent_id << ": ";
-				BOOST_FOREACH (nlp::chunk chk, test_data[test_cnt].chunks) {
-					BOOST_FOREACH (nlp::token tok, chk.tokens) {
-						if (tok.has_mod) {
-							std::string mod_str;
-							tok.mod.str(mod_str);
-							std::cout << "  " << mod_str << std::endl;
-						}
-					}
-				}
-#endif
-
-				for (unsigned int chk_cnt=0 ; chk_cnt<test_data[test_cnt].chunks.size() ; ++chk_cnt) {
-					for (unsigned int tok_cnt=0 ; tok_cnt<test_data[test_cnt].chunks[chk_cnt].tokens.size() ; ++tok_cnt) {
-						nlp::token tok_gold = split_data[step][test_cnt].chunks[chk_cnt].tokens[tok_cnt];
-						nlp::token tok_sys = test_data[test_cnt].chunks[chk_cnt].tokens[tok_cnt];
-						if (tok_gold.has_mod && tok_sys.has_mod) {
-							std::stringstream id_ss;
-							id_ss << test_data[test_cnt].sent_id << "_" << tok_sys.id;
-
-							BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
-								evals[i].add( id_ss.str() , tok_gold.mod.tag[mod_parser.id2tag(i)], tok_sys.mod.tag[mod_parser.id2tag(i)] );
-								os[i] << id_ss.str() << "," << tok_gold.mod.tag[mod_parser.id2tag(i)] << "," << tok_sys.mod.tag[mod_parser.id2tag(i)] << std::endl;
-							}
-						}
-						else if (tok_sys.has_mod && !tok_gold.has_mod) {
-							std::cerr << "ERROR: modality tag does not exist in token " << tok_sys.id << " in " << test_data[test_cnt].sent_id << std::endl;
-						}
-					}
-				}
-			}
-
-			BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
-				os[i].close();
-			}
-		}
+		evaluator evals[LABEL_NUM];
+		validator.merge(evals);
 
 		BOOST_FOREACH (unsigned int i, mod_parser.analyze_tags) {
 			std::cout << "* " << mod_parser.id2tag(i) << std::endl;
@@ -309,12 +642,38 @@ int main(int argc, char *argv[]) {
 
 	}
 	else {
-		mod_parser.learn();
-	}
+		if (argmap.count("search") || argmap.count("dump-features")) {
+			if (!argmap.count("dump-features")) {
+				mod_parser.extract_features(matrices, fast);
+			}
+			if (!mod_parser.check_feature_ids(matrices) || (fast != NULL && !mod_parser.check_feature_ids(fast))) {
+				exit(-1);
+			}
+		}
+		if (argmap.count("search")) {
+			search_hyperparams(mod_parser, matrices, searcher, jobs, outdir_path);
+			mod_parser.train_models(matrices);
+		}
+		else if (argmap.count("dump-features")) {
+			mod_parser.train_models(matrices);
+		}
+		else {
+			mod_parser.learn();
+		}
+		// learn() trains the fast models and the target detector itself
+		if (argmap.count("search") || argmap.count("dump-features")) {
+			if (fast != NULL) {
+				mod_parser.train_models(fast_matrices, true);
+			}
+			if (mod_parser.target_detection == modality::DETECT_BY_ML) {
+				mod_parser.learn_target();
+			}
+		}
 
-	mod_parser.save_f2i();
-	mod_parser.save_l2i();
-	mod_parser.save_i2l();
+		mod_parser.save_f2i();
+		mod_parser.save_l2i();
+		mod_parser.save_i2l();
+	}
 
 	return 1;
 }
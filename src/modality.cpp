@@ -1,4 +1,5 @@
 #include <cstdlib>
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -6,19 +7,20 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
 #include <boost/foreach.hpp>
-#include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 #include <sstream>
 #include <cabocha.h>
 #include <iomanip>
 
-#include "../tinyxml2/tinyxml2.h"
 #include "sentence.hpp"
 #include "modality.hpp"
 #include "cdbmap.hpp"
 #include "util.hpp"
+#include "xml_reader.hpp"
 
 namespace modality {
 	std::string parser::id2tag(unsigned int id) {
@@ -51,10 +53,14 @@ namespace modality {
 		for (unsigned int i=0 ; i<LABEL_NUM ; ++i) {
 			boost::filesystem::path mp("model_" + id2tag(i));
 			model_path[i] = dir_path / mp;
+			boost::filesystem::path fmp("model_" + id2tag(i) + "_fast");
+			fast_model_path[i] = dir_path / fmp;
 
 			boost::filesystem::path fp("feat_" + id2tag(i));
 			feat_path[i] = dir_path / fp;
 		}
+		boost::filesystem::path tmp("model_target");
+		target_model_path = dir_path / tmp;
 		
 		boost::filesystem::path l2ip("label2id.cdb");
 		l2i_path = dir_path / l2ip;
@@ -71,53 +77,56 @@ namespace modality {
 		boost::filesystem::path f2idp("feat2id.cdb.dump");
 		f2id_path = dir_path / f2idp;
 
+		boost::filesystem::path fhp("feature_hash");
+		feature_hash_path = dir_path / fhp;
+		model_dir_ok = read_feature_hash(feature_hash_path, &feature_hash_bits);
+
 		open_f2i_cdb();
 		open_l2i_cdb();
 		open_i2l_cdb();
 	}
 
 
+	/*
+	 * bits of a feature_hash file, 0 when there is no file; false for an
+	 * invalid file, leaving bits 0
+	 */
+	bool parser::read_feature_hash(const boost::filesystem::path &path, int *bits) {
+		*bits = 0;
+		if (!boost::filesystem::exists(path)) {
+			return true;
+		}
+		std::ifstream ifs(path.string().c_str());
+		if (!(ifs >> *bits) || *bits < 1 || FEATURE_HASH_MAX_BITS < *bits) {
+			std::cerr << "ERROR: invalid " << path.string() << std::endl;
+			*bits = 0;
+			return false;
+		}
+		return true;
+	}
+
+
 	bool parser::detect_target(nlp::token &tok, nlp::sentence &sent) {
-		nlp::token *t;
 		switch (target_detection) {
 			case DETECT_BY_POS:
-				{
-					std::vector< std::vector< std::string > > poss;
-					for (int i=0 ; i<max_num_tok_target ; ++i) {
-						t = sent.get_token(tok.id+i);
-						if (t!=NULL) {
-							std::vector<std::string> _pos;
-							_pos.push_back(t->pos);
-							_pos.push_back(t->pos1);
-							poss.push_back(_pos);
-						}
-					}
-
-					BOOST_FOREACH (std::vector< std::vector<std::string> > t_poss, target_pos) {
-						bool is_target = true;
-						if (t_poss.size() > poss.size())
-							continue;
-						for (int i=0 ; i<t_poss.size() ; ++i) {
-							if (t_poss[i][0] == poss[i][0] && ( t_poss[i][1] == "*" || t_poss[i][1] == poss[i][1] )) {
-							}
-							else {
-								is_target = false;
-								break;
-							}
-						}
-						if (is_target)
-							return true;
-					}
-					break;
+				if (match_target_pos(tok, sent)) {
+					return true;
 				}
+				break;
 			case DETECT_BY_PAS:
 				if (tok.pas.is_pred()) {
 					return true;
 				}
 				break;
 			case DETECT_BY_ML:
-				std::cerr << "SORRY: this method has not been implemented" << std::endl;
-				return false;
+				if (!match_target_pos(tok, sent)) {
+					return false;
+				}
+				// while learning, the detector is learned from these candidates
+				if (target_model == NULL || target_probability(tok, sent) >= target_threshold) {
+					return true;
+				}
+				break;
 			case DETECT_BY_GOLD:
 				if (tok.has_mod) {
 					return true;
@@ -131,6 +140,76 @@ namespace modality {
 	}
 
 
+	// whether the POS sets of target_pos match the tokens from tok
+	bool parser::match_target_pos(nlp::token &tok, nlp::sentence &sent) {
+		if (!match_pos_strings) {
+			return target_matcher.match(tok, sent);
+		}
+		BOOST_FOREACH (const std::vector< std::vector<std::string> > &t_poss, target_pos) {
+			bool is_target = true;
+			for (unsigned int i=0 ; i<t_poss.size() && is_target ; ++i) {
+				nlp::token *t = sent.get_token(tok.id+i);
+				is_target = t != NULL && t_poss[i][0] == t->pos && (t_poss[i].size() < 2 || t_poss[i][1] == "*" || t_poss[i][1] == t->pos1);
+			}
+			if (is_target) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+
+	/*
+	 * analyze only the given tags, separated by commas, and the tags their
+	 * features depend on; called before load_models(), which then loads the
+	 * models of these tags only
+	 */
+	bool parser::set_analyze_tags(const std::string &tags_str) {
+		std::vector<std::string> names;
+		boost::algorithm::split(names, tags_str, boost::algorithm::is_any_of(","));
+
+		bool selected[LABEL_NUM];
+		for (unsigned int i=0 ; i<LABEL_NUM ; ++i) {
+			selected[i] = false;
+		}
+		std::vector<unsigned int> stack;
+		BOOST_FOREACH (const std::string &name, names) {
+			bool found = false;
+			BOOST_FOREACH (unsigned int i, analyze_tags) {
+				if (id2tag(i) == name) {
+					found = true;
+					stack.push_back(i);
+				}
+			}
+			if (!found) {
+				std::cerr << "ERROR: no such tag to analyze: " << name << std::endl;
+				return false;
+			}
+		}
+		while (!stack.empty()) {
+			unsigned int i = stack.back();
+			stack.pop_back();
+			if (selected[i]) {
+				continue;
+			}
+			selected[i] = true;
+			BOOST_FOREACH (unsigned int dep, tag_deps[i]) {
+				stack.push_back(dep);
+			}
+		}
+
+		// in the order of analysis
+		std::vector<unsigned int> tags;
+		BOOST_FOREACH (unsigned int i, analyze_tags) {
+			if (selected[i]) {
+				tags.push_back(i);
+			}
+		}
+		analyze_tags = tags;
+		return true;
+	}
+
+
 	bool parser::load_models(boost::filesystem::path *model_path_new) {
 		model_path = model_path_new;
 		return load_models();
@@ -138,6 +217,10 @@ namespace modality {
 
 
 	bool parser::load_models() {
+		if (!model_dir_ok) {
+			return false;
+		}
+		free_models();
 		BOOST_FOREACH (unsigned int i, analyze_tags) {
 			if (!boost::filesystem::exists(model_path[i].string())) {
 				std::cerr << "ERROR: " << model_path[i].string() << " not found" << std::endl;
@@ -148,6 +231,58 @@ namespace modality {
 				std::cerr << "loaded " << model_path[i].string() << ": " << boost::filesystem::file_size(model_path[i]) << " byte, " << boost::posix_time::from_time_t(boost::filesystem::last_write_time(model_path[i])) << std::endl;
 #endif
 				models[i] = linear::load_model( model_path[i].string().c_str() );
+				if (models[i] == NULL) {
+					std::cerr << "ERROR: cannot read " << model_path[i].string() << std::endl;
+					return false;
+				}
+			}
+		}
+
+		if (cascade) {
+			BOOST_FOREACH (unsigned int i, analyze_tags) {
+				if (!boost::filesystem::exists(fast_model_path[i])) {
+					std::cerr << "ERROR: " << fast_model_path[i].string() << " not found; it is learned by zunda-train --cascade" << std::endl;
+					return false;
+				}
+				fast_models[i] = linear::load_model(fast_model_path[i].string().c_str());
+				if (fast_models[i] == NULL) {
+					std::cerr << "ERROR: cannot read " << fast_model_path[i].string() << std::endl;
+					return false;
+				}
+			}
+		}
+
+		if (target_detection == DETECT_BY_ML) {
+			if (!boost::filesystem::exists(target_model_path)) {
+				std::cerr << "ERROR: " << target_model_path.string() << " not found" << std::endl;
+				return false;
+			}
+			target_model = linear::load_model(target_model_path.string().c_str());
+			if (target_model == NULL || !linear::check_probability_model(target_model)) {
+				std::cerr << "ERROR: " << target_model_path.string() << " is not a logistic regression model" << std::endl;
+				return false;
+			}
+			target_event_idx = -1;
+			for (int k=0 ; k<target_model->nr_class ; ++k) {
+				if (target_model->label[k] == 1) {
+					target_event_idx = k;
+				}
+			}
+		}
+
+		// mod_labels ids of the classes of the models, by label id
+		BOOST_FOREACH (unsigned int i, analyze_tags) {
+			for (unsigned int f=0 ; f<(cascade ? 2 : 1) ; ++f) {
+				const linear::model *m = (f == 0) ? models[i] : fast_models[i];
+				for (int k=0 ; k<m->nr_class ; ++k) {
+					std::string label;
+					if (m->label[k] > 0 && i2l.get(m->label[k], &label)) {
+						if ((int)pred_labels.size() <= m->label[k]) {
+							pred_labels.resize(m->label[k]+1, -1);
+						}
+						pred_labels[m->label[k]] = nlp::mod_labels::id(label);
+					}
+				}
 			}
 		}
 
@@ -157,6 +292,96 @@ namespace modality {
 	}
 
 
+	// the models of every tag, as analyze_tags may have changed since loading
+	void parser::free_models() {
+		for (unsigned int i=0 ; i<LABEL_NUM ; ++i) {
+			linear::free_and_destroy_model(&models[i]);
+			models[i] = NULL;
+			linear::free_and_destroy_model(&fast_models[i]);
+			fast_models[i] = NULL;
+		}
+		linear::free_and_destroy_model(&target_model);
+		target_model = NULL;
+		model_loaded = false;
+	}
+
+
+	double parser::target_probability(nlp::token &tok, nlp::sentence &sent) {
+		// learned from events only or from no event
+		if (target_model->nr_class < 2) {
+			return (target_event_idx == 0) ? 1.0 : 0.0;
+		}
+
+		feature_generator2 fgen(&sent, sent.get_chunk(sent.t2c[tok.id]), &tok);
+		fgen.gen_feature_target();
+		t_feat compiled_feat;
+		fgen.compile_feat(target_feats, compiled_feat);
+		std::vector< linear::feature_node > xx(compiled_feat.size()+1);
+		pack_feat_linear(compiled_feat, &xx[0]);
+
+		double probs[2];
+		linear::predict_probability(target_model, &xx[0], probs);
+		return probs[target_event_idx];
+	}
+
+
+	/*
+	 * prediction of the fast model of a tag for the cascade, taken when the
+	 * margin of its decision values is cascade_threshold or more: the value
+	 * of a two-class model, or the best value over the second one
+	 */
+	bool parser::predict_fast(unsigned int tag_id, feature_generator2 &fgen, unsigned int tok_id, int *predicted) {
+		const linear::model *m = fast_models[tag_id];
+		t_feat compiled_feat;
+		std::vector< linear::feature_node > xx;
+		{
+			stat_timer timer(ST_PACK);
+			fgen.compile_feat(fast_feats[tag_id], compiled_feat);
+			xx.resize(compiled_feat.size()+1);
+			pack_feat_linear(compiled_feat, &xx[0]);
+		}
+
+		t_decision decision;
+		decision.tok_id = tok_id;
+		decision.tag = tag_id;
+		decision.values.resize((m->nr_class == 2 && m->param.solver_type != linear::MCSVM_CS) ? 1 : m->nr_class);
+		{
+			stat_timer timer(ST_PREDICT);
+			decision.label = linear::predict_values(m, &xx[0], &decision.values[0]);
+		}
+
+		double margin = HUGE_VAL;
+		if (m->nr_class >= 2 && decision.values.size() == 1) {
+			margin = fabs(decision.values[0]);
+		}
+		else if (m->nr_class >= 2) {
+			double best = -HUGE_VAL, second = -HUGE_VAL;
+			BOOST_FOREACH (double v, decision.values) {
+				if (v > best) {
+					second = best;
+					best = v;
+				}
+				else if (v > second) {
+					second = v;
+				}
+			}
+			margin = best - second;
+		}
+		if (margin < cascade_threshold) {
+			return false;
+		}
+
+		*predicted = decision.label;
+		if (decisions != NULL) {
+			if (decision_features) {
+				fgen.compile_feat_str(fast_feats[tag_id], decision.feat_str);
+			}
+			decisions->push_back(decision);
+		}
+		return true;
+	}
+
+
 	bool parser::analyze(const std::string &str, const int input_layer, nlp::sentence &sent) {
 		switch (pos_tag) {
 			case POS_IPA:
@@ -173,8 +398,11 @@ namespace modality {
 		std::string parsed_text;
 		switch (input_layer) {
 			case IN_RAW:
-				sent.da_tool = sent.CaboCha;
-				parsed_text = cabocha->parseToString( str.c_str() );
+				{
+					stat_timer timer(ST_CABOCHA);
+					sent.da_tool = sent.CaboCha;
+					parsed_text = cabocha->parseToString( str.c_str() );
+				}
 				break;
 			case IN_DEP_CAB:
 			case IN_PAS_SYN:
@@ -190,7 +418,11 @@ namespace modality {
 				std::cerr << "invalid input layer" << std::endl;
 				break;
 		}
-		sent.parse(parsed_text);
+		{
+			stat_timer timer(ST_SENT_PARSE);
+			sent.parse(parsed_text);
+		}
+		stats::count(SC_SENTS);
 
 		return analyze(sent);
 	}
@@ -202,6 +434,10 @@ namespace modality {
 
 
 	void parser::pack_feat_linear(t_feat &feat, linear::feature_node *xx) {
+		if (feature_hash_bits > 0) {
+			pack_feat_hashed(feat, xx);
+			return;
+		}
 		int feat_cnt = 0;
 		int feat_id;
 		BOOST_FOREACH (t_feat::value_type& f, feat) {
@@ -213,6 +449,8 @@ namespace modality {
 			else {
 			}
 		}
+		stats::count(SC_FEATURES, feat.size());
+		stats::count(SC_UNKNOWN_FEATURES, feat.size() - feat_cnt);
 
 		if (feat_cnt > 0) {
 			std::sort(xx, xx+feat_cnt-1, comp_xx);
@@ -221,7 +459,46 @@ namespace modality {
 	}
 
 
+	/*
+	 * the hashing trick: a feature is the bucket of its MurmurHash2, and the
+	 * features falling into a bucket are one feature of their summed values
+	 */
+	void parser::pack_feat_hashed(t_feat &feat, linear::feature_node *xx) {
+		cdbpp::murmurhash2 hash;
+		uint32_t mask = ((uint32_t)1 << feature_hash_bits) - 1;
+		int feat_cnt = 0;
+		BOOST_FOREACH (t_feat::value_type& f, feat) {
+			xx[feat_cnt].index = (hash(f.first.data(), f.first.size()) & mask) + 1;
+			xx[feat_cnt].value = f.second;
+			++feat_cnt;
+		}
+		stats::count(SC_FEATURES, feat.size());
+
+		std::sort(xx, xx+feat_cnt, comp_xx);
+		int n = 0;
+		for (int i=0 ; i<feat_cnt ; ++i) {
+			if (n > 0 && xx[n-1].index == xx[i].index) {
+				xx[n-1].value += xx[i].value;
+			}
+			else {
+				xx[n++] = xx[i];
+			}
+		}
+		xx[n].index = -1;
+	}
+
+
+	// number of feature ids of the problems given to liblinear
+	int parser::feature_dim() {
+		if (feature_hash_bits > 0) {
+			return (1 << feature_hash_bits) + 1;
+		}
+		return f2i.map.size()+1;
+	}
+
+
 	inline void sentToString(const nlp::sentence &parsed_sent, std::string &parsed_str) {
+		stat_timer timer(ST_OUTPUT);
 		std::stringstream cabocha_ss;
 
 		int eve_id = 0;
@@ -263,11 +540,19 @@ namespace modality {
 		std::vector<nlp::token>::reverse_iterator rit_tok;
 		std::vector<nlp::chunk>::reverse_iterator sc_end = sent.chunks.rend();
 		std::vector<nlp::token>::reverse_iterator st_end;
+		chunk_cache cache(&sent);
 
 		for (rit_chk=sent.chunks.rbegin() ; rit_chk!=sc_end ; ++rit_chk) {
 			st_end = rit_chk->tokens.rend();
 			for(rit_tok=rit_chk->tokens.rbegin() ; rit_tok!=st_end ; ++rit_tok) {
-				if (detect_target(*rit_tok, sent)) {
+				stats::count(SC_TOKENS);
+				bool is_target;
+				{
+					stat_timer timer(ST_DETECT_TARGET);
+					is_target = detect_target(*rit_tok, sent);
+				}
+				if (is_target) {
+					stats::count(SC_TARGETS);
 #ifdef _MODEBUG
 					std::string chk_str;
 					rit_chk->str(chk_str);
@@ -277,15 +562,24 @@ namespace modality {
 					rit_tok->has_mod = true;
 					rit_chk->has_mod = true;
 
-					feature_generator2 fgen(&sent, &(*rit_chk), &(*rit_tok));
+					feature_generator2 fgen(&sent, &(*rit_chk), &(*rit_tok), use_chunk_cache ? &cache : NULL);
 					fgen.gen_feature_basic(3);
 					fgen.gen_feature_function();
-					fgen.gen_feature_dst_chunks();
-					fgen.gen_feature_ttj(&dbr_ttj);
+					// with the cascade, the features of the full models are
+					// generated when a fast model first leaves a tag to them
+					bool full_done = false;
+					if (!cascade) {
+						fgen.gen_feature_dst_chunks();
+						fgen.gen_feature_ttj(&dbr_ttj);
+						full_done = true;
+					}
 
 
 					t_feat::iterator it_feat;
 
+					// fadic_* are the same for every tag once the tense of the
+					// token is predicted, so they are generated once
+					bool fadic_done = false;
 					BOOST_FOREACH (unsigned int i, analyze_tags) {
 						switch (i) {
 							case TENSE:
@@ -293,290 +587,853 @@ namespace modality {
 							case ASSUMPTIONAL:
 								break;
 							case TYPE:
-								fgen.gen_feature_mod("tense");
-								fgen.gen_feature_fadic(&dbr_fadic);
 								break;
 							case AUTHENTICITY:
-								fgen.gen_feature_mod("type");
-								fgen.gen_feature_fadic(&dbr_fadic);
+								fgen.gen_feature_mod(TYPE);
 								break;
 							case SENTIMENT:
-								fgen.gen_feature_fadic(&dbr_fadic);
 								break;
 						}
+						stats::count(SC_INSTANCES);
+
+						int predicted;
+						bool decided = cascade && predict_fast(i, fgen, rit_tok->id, &predicted);
+						if (cascade) {
+							__sync_fetch_and_add(&cascade_preds[decided ? 0 : 1], 1);
+						}
+						if (!decided) {
+							if (!full_done) {
+								fgen.gen_feature_dst_chunks();
+								fgen.gen_feature_ttj(&dbr_ttj);
+								full_done = true;
+							}
+							if (use_fadic[i] && !fadic_done) {
+								fgen.gen_feature_fadic(&dbr_fadic);
+								fadic_done = true;
+							}
 
-						t_feat compiled_feat;
-						fgen.compile_feat( use_feats[i], compiled_feat );
-						linear::feature_node* xx;
-						xx = new linear::feature_node[compiled_feat.size()+1];
-						pack_feat_linear(compiled_feat, xx);
+							t_feat compiled_feat;
+							linear::feature_node* xx;
+							{
+								stat_timer timer(ST_PACK);
+								fgen.compile_feat( use_feats[i], compiled_feat );
+								xx = new linear::feature_node[compiled_feat.size()+1];
+								pack_feat_linear(compiled_feat, xx);
+							}
 
-						int predicted = linear::predict(models[i], xx);
-						delete [] xx;
+							if (decisions != NULL) {
+								const linear::model *m = models[i];
+								t_decision decision;
+								decision.tok_id = rit_tok->id;
+								decision.tag = i;
+								decision.values.resize((m->nr_class == 2 && m->param.solver_type != linear::MCSVM_CS) ? 1 : m->nr_class);
+								predicted = linear::predict_values(m, xx, &decision.values[0]);
+								decision.label = predicted;
+								if (decision_features) {
+									fgen.compile_feat_str(use_feats[i], decision.feat_str);
+								}
+								decisions->push_back(decision);
+							}
+							else {
+								stat_timer timer(ST_PREDICT);
+								predicted = linear::predict(models[i], xx);
+							}
+							delete [] xx;
+						}
 						std::string label;
-						if (i2l.get(predicted, &label)) {
-							rit_tok->mod.tag[id2tag(i)] = label;
+						if (0 < predicted && predicted < (int)pred_labels.size() && pred_labels[predicted] >= 0) {
+							rit_tok->mod.tag[i] = pred_labels[predicted];
+						}
+						else if (i2l.get(predicted, &label)) {
+							rit_tok->mod.set(i, label);
 						}
 						else {
-							std::cerr << "ERORR: unknown predicted label: " << predicted << std::endl;
-							exit(-1);
+							std::cerr << "ERROR: unknown predicted label: " << predicted << std::endl;
+							return false;
 						}
 
 #ifdef _MODEBUG
 						std::string feat_str;
 						fgen.compile_feat_str(use_feats[i], feat_str);
-						std::cerr << " " << id2tag(i) << ": " << feat_str << " -> " << label << "(" << predicted << ")" << std::endl;
+						std::cerr << " " << id2tag(i) << ": " << feat_str << " -> " << rit_tok->mod.get(i) << "(" << predicted << ")" << std::endl;
 #endif
 					}
 				}
 			}
 		}
+		if (mem_stats::enabled()) {
+			size_t n = mem_stats::count_sentence();
+			if (mem_stats::want_sample(n)) {
+				sample_memo_maps(n);
+			}
+		}
 		return true;
 	}
 
 
-	void parser::load_deppasmods(std::vector< std::string > deppasmods, int input_layer) {
-		learning_data.clear();
-		
-		BOOST_FOREACH ( std::string deppasmod, deppasmods ) {
-			std::cout << deppasmod << std::endl;
-			boost::filesystem::path p(deppasmod);
-#if BOOST_VERSION >= 104600
-			std::string sent_id = p.stem().string();
-#elif BOOST_VERSION >= 103600
-			std::string sent_id = p.stem();
-#endif
-
-			nlp::sentence sent;
-			sent.sent_id = sent_id;
-			switch (pos_tag) {
-				case POS_IPA:
-					sent.ma_dic = nlp::sentence::IPADic;
-					break;
-				case POS_JUMAN:
-					sent.ma_dic = nlp::sentence::JumanDic;
-					break;
-				case POS_UNI:
-					sent.ma_dic = nlp::sentence::UniDic;
-					break;
-			}
-			switch (input_layer) {
-				case IN_DEP_CAB:
-				case IN_PAS_SYN:
-					sent.da_tool = nlp::sentence::CaboCha;
-					break;
-				case IN_DEP_KNP:
-				case IN_PAS_KNP:
-					sent.da_tool = nlp::sentence::KNP;
-					break;
-				default:
-					std::cerr << "invalid input layer" << std::endl;
-					break;
-			}
-
-			std::ifstream ifs(deppasmod.c_str());
-			std::string buf, str;
-			std::vector< std::string > lines;
-			while ( getline(ifs, buf) ) {
-				lines.push_back(buf);
+	/*
+	 * static footprint of the components loaded by the constructor and
+	 * load_models(), for --mem-stats; the cdb files are read into memory as a
+	 * whole and liblinear allocates its models with malloc, so both are
+	 * estimated from their sizes rather than counted
+	 */
+	void parser::add_mem_components() {
+		const char *cdbs[2] = {"ttjcore2seq.cdb", "FAdic.cdb"};
+		for (unsigned int i=0 ; i<2 ; ++i) {
+			boost::filesystem::path p = dic_path / cdbs[i];
+			if (boost::filesystem::exists(p)) {
+				mem_stats::add_component(std::string("dic:") + cdbs[i], boost::filesystem::file_size(p));
 			}
-			sent.parse(lines);
-
-			learning_data.push_back(sent);
 		}
-	}
-	
-	void parser::load_xmls(std::vector< std::string > xmls, int input_format) {
-		BOOST_FOREACH ( std::string xml_path, xmls ) {
-			std::cout << xml_path << std::endl;
-			boost::filesystem::path p(xml_path);
-#if BOOST_VERSION >= 104600
-			std::string doc_id = p.stem().string();
-#elif BOOST_VERSION >= 103600
-			std::string doc_id = p.stem();
-#endif
-			
-			std::vector< std::vector< t_token > > oc_sents = parse_OC(xml_path);
-			std::vector< nlp::sentence > parsed_sents;
-			unsigned int sent_cnt = 0;
-			BOOST_FOREACH ( std::vector< t_token > oc_sent, oc_sents ) {
-				nlp::sentence mod_ipa_sent;
-				make_tagged_ipasents( oc_sent, input_format, mod_ipa_sent );
-				mod_ipa_sent.doc_id = doc_id;
-				std::stringstream sent_id;
-				sent_id << doc_id << "_" << std::setw(3) << std::setfill('0') << sent_cnt;
-				sent_cnt++;
-				mod_ipa_sent.sent_id = sent_id.str();
-				learning_data.push_back(mod_ipa_sent);
+		boost::filesystem::path maps[3] = {f2i_path, l2i_path, i2l_path};
+		for (unsigned int i=0 ; i<3 ; ++i) {
+			if (boost::filesystem::exists(maps[i])) {
+				mem_stats::add_component("map:" + boost::filesystem::path(maps[i].filename()).string(), boost::filesystem::file_size(maps[i]));
 			}
 		}
+		if (!model_loaded) {
+			return;
+		}
+		BOOST_FOREACH (unsigned int i, analyze_tags) {
+			const linear::model *m = models[i];
+			int64_t n = m->nr_feature + (m->bias >= 0 ? 1 : 0);
+			int64_t nr_w = (m->nr_class == 2 && m->param.solver_type != linear::MCSVM_CS) ? 1 : m->nr_class;
+			mem_stats::add_component("model:" + id2tag(i), sizeof(linear::model) + n * nr_w * sizeof(double) + m->nr_class * sizeof(int));
+		}
 	}
 
 
-	void parser::learn(boost::filesystem::path *model_path_new, boost::filesystem::path *feat_path_new) {
-		model_path = model_path_new;
-		feat_path = feat_path_new;
-		learn();
+	void parser::sample_memo_maps(size_t sents) {
+		mem_stats::t_memo_sample sample;
+		sample.sents = sents;
+		sample.entries[0] = f2i.size();
+		sample.entries[1] = l2i.size();
+		sample.entries[2] = i2l.size();
+		sample.bytes[0] = f2i.memo_bytes();
+		sample.bytes[1] = l2i.memo_bytes();
+		sample.bytes[2] = i2l.memo_bytes();
+		mem_stats::add_sample(sample);
 	}
 
 
-	void parser::learn() {
-		int num_node = 0;
-		
-		// count a number of instances for liblinear
-		BOOST_FOREACH (nlp::sentence sent, learning_data) {
-			BOOST_FOREACH (nlp::chunk chk, sent.chunks) {
-				BOOST_FOREACH (nlp::token tok, chk.tokens) {
-					if (detect_target(tok, sent) && tok.has_mod) {
-						num_node++;
-					}
-				}
-			}
-		}
-		std::cout << num_node << " nodes for liblinear" << std::endl;
+	void parser::load_deppasmods(std::vector< std::string > deppasmods, int input_layer) {
+		learning_data.clear();
 
-		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
-			linear::feature_node **x = new linear::feature_node*[num_node+1];
-			int y[num_node+1];
+		std::vector< std::string > names;
+		std::vector< t_pack_record > records;
+		std::vector< packed_corpus_reader* > packs;
+		open_deppasmods(deppasmods, names, records, packs);
 
-			int node_cnt = 0;
-			
-			std::ofstream ofs(feat_path[tag_id].string().c_str());
-
-			BOOST_FOREACH (nlp::sentence sent, learning_data) {
-				BOOST_FOREACH (nlp::chunk chk, sent.chunks) {
-					BOOST_FOREACH (nlp::token tok, chk.tokens) {
-						if (detect_target(tok, sent) && tok.has_mod) {
-							std::string label = tok.mod.tag[id2tag(tag_id)];
-							if (!l2i.exists_on_map(label)) {
-								int lid = l2i.size()+1;
-								l2i.set(label, lid);
-								i2l.set(lid, label);
-							}
-							static int label_id;
-							l2i.get(label, &label_id);
-							y[node_cnt] = label_id;
-
-							std::stringstream tok_id_full;
-							tok_id_full << sent.sent_id << "_" << chk.id << "_" << tok.id;
-
-							feature_generator2 fgen(&sent, &chk, &tok);
-							fgen.gen_feature_basic(3);
-							fgen.gen_feature_function();
-							fgen.gen_feature_dst_chunks();
-							fgen.gen_feature_ttj(&dbr_ttj);
-
-							//fgen.update(sent);
-							switch (tag_id) {
-								case TENSE:
-									break;
-								case ASSUMPTIONAL:
-									break;
-								case TYPE:
-									fgen.gen_feature_mod("tense");
-									fgen.gen_feature_fadic(&dbr_fadic);
-									break;
-								case AUTHENTICITY:
-									fgen.gen_feature_mod("type");
-									fgen.gen_feature_fadic(&dbr_fadic);
-									break;
-								case SENTIMENT:
-									fgen.gen_feature_fadic(&dbr_fadic);
-									break;
-							}
-							
-							std::string feat_str;
-							fgen.compile_feat_str(use_feats[tag_id], feat_str);
-							ofs << sent.sent_id << "(" << chk.id << "_" << tok.id << "): " << feat_str << std::endl;
+		load_queue queue(&names, input_layer);
+		queue.records = &records;
+		run_loaders(queue, &parser::load_deppasmod_worker);
 
-							t_feat compiled_feat;
-							fgen.compile_feat( use_feats[tag_id], compiled_feat );
-							t_feat::iterator it_feat;
-							for (it_feat=compiled_feat.begin() ; it_feat!=compiled_feat.end() ; ++it_feat) {
-								if (!f2i.exists_on_map(it_feat->first)) {
-									f2i.set(it_feat->first, f2i.size()+1);
-								}
-							}
+		learning_data.resize(names.size());
+		for (unsigned int i=0 ; i<names.size() ; ++i) {
+			std::swap(learning_data[i], queue.docs[i][0]);
+		}
 
-							linear::feature_node* xx;
-							xx = new linear::feature_node[compiled_feat.size()+1];
-							pack_feat_linear(compiled_feat, xx);
-							x[node_cnt] = xx;
-							node_cnt++;
-						}
-					}
-				}
+		BOOST_FOREACH (packed_corpus_reader *pack, packs) {
+			delete pack;
+		}
+	}
+
+
+	/*
+	 * expand packed corpora among the files into their sentences, so that the
+	 * loaders can share the sentences of one pack
+	 */
+	void parser::open_deppasmods(const std::vector< std::string > &deppasmods, std::vector< std::string > &names, std::vector< t_pack_record > &records, std::vector< packed_corpus_reader* > &packs) {
+		BOOST_FOREACH (const std::string &path, deppasmods) {
+			t_pack_record rec;
+			rec.pack = NULL;
+			rec.record = 0;
+			if (!packed_corpus_reader::is_packed(path)) {
+				names.push_back(path);
+				records.push_back(rec);
+				continue;
 			}
-			
-			ofs.close();
 
-			linear::parameter _param;
-			_param.solver_type = linear::L2R_LR;
-			_param.eps = 0.01;
-			_param.C = 1;
-			_param.nr_weight = 0;
-			_param.weight_label = new int(1);
-			_param.weight = new double(1.0);
+			packed_corpus_reader *pack = new packed_corpus_reader;
+			if (!pack->open(path)) {
+				std::cerr << "ERROR: cannot open packed corpus " << path << std::endl;
+				exit(-1);
+			}
+			packs.push_back(pack);
+			rec.pack = pack;
+			for (size_t i=0 ; i<pack->size() ; ++i) {
+				rec.record = i;
+				names.push_back(path + "#" + boost::lexical_cast<std::string>(i));
+				records.push_back(rec);
+			}
+		}
+	}
 
-			linear::problem _prob;
-			_prob.l = num_node;
-			_prob.n = f2i.map.size()+1;
-			_prob.y = y;
-			_prob.x = x;
-			_prob.bias = -1;
 
-			linear::model *model;
-			model = linear::train(&_prob, &_param);
-			linear::save_model(model_path[tag_id].string().c_str(), model);
+	void parser::load_deppasmod_worker(load_queue *queue) {
+		unsigned int i;
+		while (queue->pop(&i)) {
+			stat_timer timer(ST_LOAD);
+			queue->docs[i].resize(1);
+			if (queue->records == NULL || (*queue->records)[i].pack == NULL) {
+				load_deppasmod((*queue->paths)[i], queue->input_layer, queue->docs[i][0]);
+				continue;
+			}
 
-			delete [] x;
+			const t_pack_record &rec = (*queue->records)[i];
+			std::string sent_id, text;
+			if (!rec.pack->read(rec.record, sent_id, text)) {
+				std::cerr << "ERROR: cannot read " << (*queue->paths)[i] << std::endl;
+				exit(-1);
+			}
+			std::istringstream iss(text);
+			load_deppasmod(sent_id, iss, queue->input_layer, queue->docs[i][0]);
 		}
 	}
 
 
-	bool parser::make_tagged_ipasents( std::vector< t_token > sent_orig, int input_layer, nlp::sentence &sent ) {
-		std::string text = "";
-		BOOST_FOREACH ( t_token tok, sent_orig ) {
-			text += tok.orthToken;
+	void parser::load_deppasmod(const std::string &deppasmod, int input_layer, nlp::sentence &sent) {
+		boost::filesystem::path p(deppasmod);
+#if BOOST_VERSION >= 104600
+		std::string sent_id = p.stem().string();
+#elif BOOST_VERSION >= 103600
+		std::string sent_id = p.stem();
+#endif
+
+		std::ifstream ifs(deppasmod.c_str());
+		load_deppasmod(sent_id, ifs, input_layer, sent);
+	}
+
+
+	void parser::load_deppasmod(const std::string &sent_id, std::istream &is, int input_layer, nlp::sentence &sent) {
+		sent.sent_id = sent_id;
+		switch (pos_tag) {
+			case POS_IPA:
+				sent.ma_dic = nlp::sentence::IPADic;
+				break;
+			case POS_JUMAN:
+				sent.ma_dic = nlp::sentence::JumanDic;
+				break;
+			case POS_UNI:
+				sent.ma_dic = nlp::sentence::UniDic;
+				break;
 		}
-		
-		std::string parsed_text;
 		switch (input_layer) {
-			case IN_XML_CAB:
 			case IN_DEP_CAB:
 			case IN_PAS_SYN:
-				parsed_text = cabocha->parseToString( text.c_str() );
-				sent.ma_dic = sent.IPADic;
-				sent.da_tool = sent.CaboCha;
-				sent.parse(parsed_text);
+				sent.da_tool = nlp::sentence::CaboCha;
 				break;
-			case IN_XML_KNP:
 			case IN_DEP_KNP:
 			case IN_PAS_KNP:
-				{
-					boost::filesystem::path tmp_knp("temp.knp");
-					tmp_knp = TMP_DIR / tmp_knp;
-					std::string com = "echo \"" + text + "\" | juman | knp -tab > " + tmp_knp.string();
-#ifdef _MODEBUG
-					std::cerr << com << std::endl;
+				sent.da_tool = nlp::sentence::KNP;
+				break;
+			default:
+				std::cerr << "invalid input layer" << std::endl;
+				break;
+		}
+
+		std::string buf;
+		std::vector< std::string > lines;
+		while ( getline(is, buf) ) {
+			lines.push_back(buf);
+		}
+		sent.parse(lines);
+	}
+
+
+	/*
+	 * run load_threads threads of the worker until the queue is empty
+	 */
+	void parser::run_loaders(load_queue &queue, void (parser::*worker)(load_queue *)) {
+		unsigned int n_threads = load_threads;
+		if (n_threads > queue.paths->size()) {
+			n_threads = queue.paths->size();
+		}
+		if (n_threads == 0) {
+			n_threads = 1;
+		}
+		boost::thread_group loaders;
+		for (unsigned int i=0 ; i<n_threads ; ++i) {
+			loaders.create_thread( boost::bind(worker, this, &queue) );
+		}
+		loaders.join_all();
+	}
+
+
+	void parser::load_xmls(std::vector< std::string > xmls, int input_format) {
+		if (input_format == IN_XML_KNP) {
+			// started before the loaders share it
+			get_knp_pool();
+		}
+
+		load_queue queue(&xmls, input_format);
+		run_loaders(queue, &parser::load_xml_worker);
+
+		BOOST_FOREACH ( std::vector< nlp::sentence > &doc, queue.docs ) {
+			size_t offset = learning_data.size();
+			learning_data.resize(offset + doc.size());
+			for (size_t i=0 ; i<doc.size() ; ++i) {
+				std::swap(learning_data[offset+i], doc[i]);
+			}
+		}
+	}
+
+
+	/*
+	 * each loader owns a CaboCha parser, since a parser is not thread-safe
+	 */
+	void parser::load_xml_worker(load_queue *queue) {
+		int input_format = queue->input_layer;
+		CaboCha::Parser *cab = NULL;
+		if (input_format != IN_XML_KNP) {
+			cab = CaboCha::createParser("-f1");
+		}
+
+		unsigned int i;
+		while (queue->pop(&i)) {
+			stat_timer timer(ST_LOAD);
+			const std::string &xml_path = (*queue->paths)[i];
+			boost::filesystem::path p(xml_path);
+#if BOOST_VERSION >= 104600
+			std::string doc_id = p.stem().string();
+#elif BOOST_VERSION >= 103600
+			std::string doc_id = p.stem();
 #endif
-					system(com.c_str());
+			
+			std::vector< std::vector< t_token > > oc_sents = parse_OC(xml_path);
 
-					std::vector<std::string> lines;
-					std::string buf;
-					std::ifstream ifs(tmp_knp.string().c_str());
-					while (ifs && getline(ifs, buf)) {
-						lines.push_back(buf);
+			// all sentences of a document are sent to the juman/knp workers at once
+			std::vector< std::vector< std::string > > knp_results;
+			if (input_format == IN_XML_KNP) {
+				std::vector< std::string > texts;
+				BOOST_FOREACH ( std::vector< t_token > &oc_sent, oc_sents ) {
+					std::string text = "";
+					BOOST_FOREACH ( t_token &tok, oc_sent ) {
+						text += tok.orthToken;
 					}
-					ifs.close();
-					if (!boost::filesystem::remove(tmp_knp)) {
-						std::cerr << "ERROR: cannot remove " << tmp_knp.string() << std::endl;
-						exit(-1);
+					texts.push_back(text);
+				}
+				if (!knp->parse_all(texts, knp_results)) {
+					exit(-1);
+				}
+			}
+
+			std::vector< nlp::sentence > &doc = queue->docs[i];
+			doc.resize(oc_sents.size());
+			for (unsigned int sent_cnt=0 ; sent_cnt<oc_sents.size() ; ++sent_cnt) {
+				nlp::sentence &mod_ipa_sent = doc[sent_cnt];
+				if (input_format == IN_XML_KNP) {
+					mod_ipa_sent.da_tool = mod_ipa_sent.KNP;
+					mod_ipa_sent.parse(knp_results[sent_cnt]);
+					tag_parsed_sent( oc_sents[sent_cnt], mod_ipa_sent );
+				}
+				else {
+					make_tagged_ipasents( oc_sents[sent_cnt], input_format, mod_ipa_sent, cab );
+				}
+				mod_ipa_sent.doc_id = doc_id;
+				std::stringstream sent_id;
+				sent_id << doc_id << "_" << std::setw(3) << std::setfill('0') << sent_cnt;
+				mod_ipa_sent.sent_id = sent_id.str();
+			}
+		}
+
+		delete cab;
+	}
+
+
+	void parser::learn(boost::filesystem::path *model_path_new, boost::filesystem::path *feat_path_new) {
+		model_path = model_path_new;
+		feat_path = feat_path_new;
+		learn();
+	}
+
+
+	void parser::train_model(linear::problem *prob, unsigned int tag_id, bool fast) {
+		linear::parameter _param;
+		_param.solver_type = solver_type[tag_id];
+		_param.eps = 0.01;
+		_param.C = cost[tag_id];
+		_param.nr_weight = 0;
+		_param.weight_label = NULL;
+		_param.weight = NULL;
+		_param.nr_thread = train_threads;
+		_param.init_sol = NULL;
+
+		stat_timer timer(ST_TRAIN);
+		linear::model *model;
+		model = linear::train(prob, &_param);
+		linear::save_model((fast ? fast_model_path[tag_id] : model_path[tag_id]).string().c_str(), model);
+		linear::free_and_destroy_model(&model);
+	}
+
+
+	void parser::learn() {
+		feature_matrix matrices[LABEL_NUM];
+		feature_matrix fast_matrices[LABEL_NUM];
+		extract_features(matrices, cascade ? fast_matrices : NULL);
+		train_models(matrices);
+		if (cascade) {
+			train_models(fast_matrices, true);
+		}
+
+		if (target_detection == DETECT_BY_ML) {
+			learn_target();
+		}
+	}
+
+
+	// the target detector of DETECT_BY_ML, from the learning data
+	void parser::learn_target() {
+		feature_matrix target_rows;
+		BOOST_FOREACH (nlp::sentence *sent, learning_sentences()) {
+			extract_target_features(*sent, &target_rows);
+		}
+		linear::problem prob;
+		target_rows.problem(&prob, feature_dim());
+		train_target_model(&prob);
+	}
+
+
+	std::vector< nlp::sentence* > parser::learning_sentences() {
+		if (!learning_refs.empty()) {
+			return learning_refs;
+		}
+		std::vector< nlp::sentence* > sents;
+		sents.reserve(learning_data.size());
+		BOOST_FOREACH (nlp::sentence &sent, learning_data) {
+			sents.push_back(&sent);
+		}
+		return sents;
+	}
+
+
+	void parser::train_target_model(linear::problem *prob) {
+		linear::parameter _param;
+		_param.solver_type = linear::L2R_LR;
+		_param.eps = 0.01;
+		_param.C = 1.0;
+		_param.nr_weight = 0;
+		_param.weight_label = NULL;
+		_param.weight = NULL;
+		_param.nr_thread = train_threads;
+		_param.init_sol = NULL;
+
+		stat_timer timer(ST_TRAIN);
+		std::cout << prob->l << " candidates for the target detector" << std::endl;
+		linear::model *model;
+		model = linear::train(prob, &_param);
+		linear::save_model(target_model_path.string().c_str(), model);
+		linear::free_and_destroy_model(&model);
+	}
+
+
+	void parser::extract_features(feature_matrix *matrices, feature_matrix *fast_matrices) {
+		std::ofstream ofs[LABEL_NUM];
+
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			matrices[tag_id].clear();
+			if (fast_matrices != NULL) {
+				fast_matrices[tag_id].clear();
+			}
+			ofs[tag_id].open(feat_path[tag_id].string().c_str());
+		}
+
+		BOOST_FOREACH (nlp::sentence *sent, learning_sentences()) {
+			extract_features(*sent, ofs, matrices, fast_matrices);
+		}
+
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			ofs[tag_id].close();
+		}
+	}
+
+
+	/*
+	 * generate features once for each instance in the sentence, compile them
+	 * for every tag and append them to the rows of the tag (feature_matrix or
+	 * feature_spill), and those of the fast models of the cascade to
+	 * fast_rows when it is set
+	 */
+	template <typename M>
+	void parser::extract_features(nlp::sentence &sent, std::ofstream *ofs, M *rows, M *fast_rows) {
+		stat_timer timer(ST_EXTRACT);
+		stats::count(SC_SENTS);
+		std::vector< linear::feature_node > xx;
+		chunk_cache cache(&sent);
+		BOOST_FOREACH (nlp::chunk &chk, sent.chunks) {
+			BOOST_FOREACH (nlp::token &tok, chk.tokens) {
+				if (!detect_target(tok, sent) || !tok.has_mod) {
+					continue;
+				}
+
+				feature_generator2 fgen(&sent, &chk, &tok, use_chunk_cache ? &cache : NULL);
+				fgen.gen_feature_basic(3);
+				fgen.gen_feature_function();
+				fgen.gen_feature_dst_chunks();
+				fgen.gen_feature_ttj(&dbr_ttj);
+				fgen.gen_feature_fadic(&dbr_fadic);
+
+				BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+					const std::string &label = tok.mod.get(tag_id);
+					if (!l2i.exists_on_map(label)) {
+						int lid = l2i.size()+1;
+						l2i.set(label, lid);
+						i2l.set(lid, label);
+					}
+					int label_id;
+					l2i.get(label, &label_id);
+
+					// gold type is given only to authenticity as a feature
+					if (tag_id == AUTHENTICITY) {
+						fgen.gen_feature_mod(TYPE);
 					}
+					t_feat compiled_feat;
+					fgen.compile_feat( use_feats[tag_id], compiled_feat );
+					// features of the fast model are a subset of the full ones
+					t_feat fast_feat;
+					if (fast_rows != NULL) {
+						fgen.compile_feat( fast_feats[tag_id], fast_feat );
+					}
+					fgen.feat_cat.erase("mod_type");
 
+					ofs[tag_id] << sent.sent_id << "(" << chk.id << "_" << tok.id << "): ";
+					t_feat::iterator it_feat;
+					for (it_feat=compiled_feat.begin() ; it_feat!=compiled_feat.end() ; ++it_feat) {
+						ofs[tag_id] << it_feat->first << ":" << it_feat->second << " ";
+						if (feature_hash_bits == 0 && !f2i.exists_on_map(it_feat->first)) {
+							f2i.set(it_feat->first, f2i.size()+1);
+						}
+					}
+					ofs[tag_id] << std::endl;
+
+					xx.resize(compiled_feat.size()+1);
+					pack_feat_linear(compiled_feat, &xx[0]);
+					rows[tag_id].add_row(label_id, &xx[0]);
+					if (fast_rows != NULL) {
+						xx.resize(fast_feat.size()+1);
+						pack_feat_linear(fast_feat, &xx[0]);
+						fast_rows[tag_id].add_row(label_id, &xx[0]);
+					}
+					stats::count(SC_INSTANCES);
+				}
+			}
+		}
+	}
+
+
+	/*
+	 * rows of the target detector of DETECT_BY_ML: every token the POS sets
+	 * detect, labeled 1 if it is an event of the learning data and -1 if not
+	 */
+	template <typename M>
+	void parser::extract_target_features(nlp::sentence &sent, M *rows) {
+		stat_timer timer(ST_EXTRACT);
+		std::vector< linear::feature_node > xx;
+		BOOST_FOREACH (nlp::chunk &chk, sent.chunks) {
+			BOOST_FOREACH (nlp::token &tok, chk.tokens) {
+				if (!match_target_pos(tok, sent)) {
+					continue;
+				}
+
+				feature_generator2 fgen(&sent, &chk, &tok);
+				fgen.gen_feature_target();
+				t_feat compiled_feat;
+				fgen.compile_feat(target_feats, compiled_feat);
+				t_feat::iterator it_feat;
+				for (it_feat=compiled_feat.begin() ; it_feat!=compiled_feat.end() ; ++it_feat) {
+					if (feature_hash_bits == 0 && !f2i.exists_on_map(it_feat->first)) {
+						f2i.set(it_feat->first, f2i.size()+1);
+					}
+				}
+
+				xx.resize(compiled_feat.size()+1);
+				pack_feat_linear(compiled_feat, &xx[0]);
+				rows->add_row(tok.has_mod ? 1 : -1, &xx[0]);
+			}
+		}
+	}
+
+
+	/*
+	 * Learn without keeping the input data: sentences are loaded in batches,
+	 * turned into rows spilled to spill_dir and dropped, and the models are
+	 * trained on the spilled rows mapped into memory.
+	 */
+	void parser::learn_stream(const std::vector< std::string > &files, int input_layer, const boost::filesystem::path &spill_dir) {
+		const unsigned int batch_size = 256;
+		std::ofstream ofs[LABEL_NUM];
+		feature_spill spills[LABEL_NUM];
+		feature_spill fast_spills[LABEL_NUM];
+		feature_spill target_spill;
+		boost::filesystem::path target_sp("spill_target");
+		if (target_detection == DETECT_BY_ML && !target_spill.open((spill_dir / target_sp).string())) {
+			std::cerr << "ERROR: cannot write " << (spill_dir / target_sp).string() << std::endl;
+			exit(-1);
+		}
+
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			ofs[tag_id].open(feat_path[tag_id].string().c_str());
+			boost::filesystem::path sp("spill_" + id2tag(tag_id));
+			if (!spills[tag_id].open((spill_dir / sp).string())) {
+				std::cerr << "ERROR: cannot write " << (spill_dir / sp).string() << std::endl;
+				exit(-1);
+			}
+			boost::filesystem::path fsp("spill_" + id2tag(tag_id) + "_fast");
+			if (cascade && !fast_spills[tag_id].open((spill_dir / fsp).string())) {
+				std::cerr << "ERROR: cannot write " << (spill_dir / fsp).string() << std::endl;
+				exit(-1);
+			}
+		}
+		if (input_layer == IN_XML_KNP) {
+			get_knp_pool();
+		}
+
+		std::vector< std::string > names;
+		std::vector< t_pack_record > records;
+		std::vector< packed_corpus_reader* > packs;
+		if (input_layer == IN_XML_CAB || input_layer == IN_XML_KNP) {
+			names = files;
+		}
+		else {
+			open_deppasmods(files, names, records, packs);
+		}
+
+		unsigned int cnt_sent = 0;
+		for (size_t begin=0 ; begin<names.size() ; begin+=batch_size) {
+			size_t end = std::min(begin + batch_size, names.size());
+			std::vector< std::string > batch(names.begin() + begin, names.begin() + end);
+			std::vector< t_pack_record > batch_records;
+			if (!records.empty()) {
+				batch_records.assign(records.begin() + begin, records.begin() + end);
+			}
+
+			load_queue queue(&batch, input_layer);
+			if (!batch_records.empty()) {
+				queue.records = &batch_records;
+			}
+			switch (input_layer) {
+				case IN_XML_CAB:
+				case IN_XML_KNP:
+					run_loaders(queue, &parser::load_xml_worker);
+					break;
+				default:
+					run_loaders(queue, &parser::load_deppasmod_worker);
+					break;
+			}
+
+			BOOST_FOREACH (std::vector< nlp::sentence > &doc, queue.docs) {
+				BOOST_FOREACH (nlp::sentence &sent, doc) {
+					extract_features(sent, ofs, spills, cascade ? fast_spills : NULL);
+					if (target_detection == DETECT_BY_ML) {
+						extract_target_features(sent, &target_spill);
+					}
+					cnt_sent++;
+				}
+			}
+		}
+		std::cout << "   " << cnt_sent << " sents" << std::endl;
+		BOOST_FOREACH (packed_corpus_reader *pack, packs) {
+			delete pack;
+		}
+
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			ofs[tag_id].close();
+			if (!spills[tag_id].close() || (cascade && !fast_spills[tag_id].close())) {
+				std::cerr << "ERROR: cannot write spilled rows of " << id2tag(tag_id) << std::endl;
+				exit(-1);
+			}
+		}
+
+		mapped_matrix matrices[LABEL_NUM];
+		linear::problem probs[LABEL_NUM];
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			boost::filesystem::path sp("spill_" + id2tag(tag_id));
+			if (!matrices[tag_id].map((spill_dir / sp).string())) {
+				std::cerr << "ERROR: cannot map " << (spill_dir / sp).string() << std::endl;
+				exit(-1);
+			}
+			matrices[tag_id].problem(&probs[tag_id], feature_dim());
+		}
+		train_problems(probs);
+
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			matrices[tag_id].unmap();
+			spills[tag_id].remove();
+		}
+
+		if (cascade) {
+			BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+				boost::filesystem::path fsp("spill_" + id2tag(tag_id) + "_fast");
+				if (!matrices[tag_id].map((spill_dir / fsp).string())) {
+					std::cerr << "ERROR: cannot map " << (spill_dir / fsp).string() << std::endl;
+					exit(-1);
+				}
+				matrices[tag_id].problem(&probs[tag_id], feature_dim());
+			}
+			train_problems(probs, true);
+
+			BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+				matrices[tag_id].unmap();
+				fast_spills[tag_id].remove();
+			}
+		}
+
+		if (target_detection == DETECT_BY_ML) {
+			mapped_matrix target_matrix;
+			linear::problem prob;
+			if (!target_spill.close() || !target_matrix.map((spill_dir / target_sp).string())) {
+				std::cerr << "ERROR: cannot map " << (spill_dir / target_sp).string() << std::endl;
+				exit(-1);
+			}
+			target_matrix.problem(&prob, feature_dim());
+			train_target_model(&prob);
+			target_matrix.unmap();
+			target_spill.remove();
+		}
+	}
+
+
+	// fast: the rows are of the fast models of the cascade
+	void parser::train_models(feature_matrix *matrices, bool fast) {
+		linear::problem probs[LABEL_NUM];
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			matrices[tag_id].problem(&probs[tag_id], feature_dim());
+		}
+		train_problems(probs, fast);
+	}
+
+
+	void parser::train_problems(linear::problem *probs, bool fast) {
+		std::cout << probs[analyze_tags[0]].l << " nodes for liblinear" << (fast ? " (fast models)" : "") << std::endl;
+
+		// models of the tags are independent of each other once the features are packed
+		boost::thread_group trainers;
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			trainers.create_thread( boost::bind(&parser::train_model, this, &probs[tag_id], tag_id, fast) );
+		}
+		trainers.join_all();
+	}
+
+
+	bool parser::save_features(const boost::filesystem::path &dir_path, feature_matrix *matrices) {
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			boost::filesystem::path mp("matrix_" + id2tag(tag_id));
+			if (!matrices[tag_id].save((dir_path / mp).string(), feature_dim())) {
+				std::cerr << "ERROR: cannot write " << (dir_path / mp).string() << std::endl;
+				return false;
+			}
+		}
+		if (!save_str2id(f2i.map, (dir_path / "feat2id.bin").string()) || !save_str2id(l2i.map, (dir_path / "label2id.bin").string())) {
+			std::cerr << "ERROR: cannot write feature and label maps to " << dir_path.string() << std::endl;
+			return false;
+		}
+		// hashed rows are only meaningful with the same bits
+		boost::filesystem::path fhp = dir_path / "feature_hash";
+		if (feature_hash_bits > 0) {
+			std::ofstream ofs(fhp.string().c_str());
+			ofs << feature_hash_bits << std::endl;
+			if (!ofs) {
+				std::cerr << "ERROR: cannot write " << fhp.string() << std::endl;
+				return false;
+			}
+		}
+		else {
+			boost::filesystem::remove(fhp);
+		}
+		return true;
+	}
+
+
+	bool parser::load_features(const boost::filesystem::path &dir_path, feature_matrix *matrices) {
+		uint64_t n_cols[LABEL_NUM];
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			boost::filesystem::path mp("matrix_" + id2tag(tag_id));
+			if (!matrices[tag_id].load((dir_path / mp).string(), n_cols[tag_id])) {
+				std::cerr << "ERROR: cannot read " << (dir_path / mp).string() << std::endl;
+				return false;
+			}
+		}
+		if (!load_str2id(f2i.map, (dir_path / "feat2id.bin").string()) || !load_str2id(l2i.map, (dir_path / "label2id.bin").string())) {
+			std::cerr << "ERROR: cannot read feature and label maps from " << dir_path.string() << std::endl;
+			return false;
+		}
+		// the bits the features were hashed with, which --feature-hash may
+		// only repeat
+		int bits;
+		if (!read_feature_hash(dir_path / "feature_hash", &bits)) {
+			return false;
+		}
+		if (feature_hash_bits > 0 && feature_hash_bits != bits) {
+			std::cerr << "ERROR: --feature-hash " << feature_hash_bits << " does not match the features in " << dir_path.string();
+			if (bits > 0) {
+				std::cerr << ", hashed with " << bits << " bits" << std::endl;
+			}
+			else {
+				std::cerr << ", which are not hashed" << std::endl;
+			}
+			return false;
+		}
+		feature_hash_bits = bits;
+		// the rows must have been packed against these maps
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			if (n_cols[tag_id] != (uint64_t)feature_dim()) {
+				std::cerr << "ERROR: matrix_" << id2tag(tag_id) << " has " << n_cols[tag_id] << " feature columns, the maps in " << dir_path.string() << " give " << feature_dim() << std::endl;
+				return false;
+			}
+		}
+		i2l.map.clear();
+		boost::unordered_map< std::string, int >::iterator it;
+		for (it=l2i.map.begin() ; it!=l2i.map.end() ; ++it) {
+			i2l.set(it->second, it->first);
+		}
+		return true;
+	}
+
+
+	// every feature id of the rows is one of the features of feature_dim()
+	bool parser::check_feature_ids(feature_matrix *matrices) {
+		BOOST_FOREACH (unsigned int tag_id, analyze_tags) {
+			int max_index = matrices[tag_id].max_index();
+			if (max_index > feature_dim()-1) {
+				std::cerr << "ERROR: the rows of " << id2tag(tag_id) << " have feature id " << max_index << ", beyond the " << feature_dim()-1 << " features" << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	bool parser::make_tagged_ipasents( std::vector< t_token > sent_orig, int input_layer, nlp::sentence &sent ) {
+		return make_tagged_ipasents(sent_orig, input_layer, sent, cabocha);
+	}
+
+
+	bool parser::make_tagged_ipasents( const std::vector< t_token > &sent_orig, int input_layer, nlp::sentence &sent, CaboCha::Parser *cab ) {
+		std::string text = "";
+		BOOST_FOREACH ( const t_token &tok, sent_orig ) {
+			text += tok.orthToken;
+		}
+		
+		std::string parsed_text;
+		switch (input_layer) {
+			case IN_XML_CAB:
+			case IN_DEP_CAB:
+			case IN_PAS_SYN:
+				parsed_text = cab->parseToString( text.c_str() );
+				sent.ma_dic = sent.IPADic;
+				sent.da_tool = sent.CaboCha;
+				sent.parse(parsed_text);
+				break;
+			case IN_XML_KNP:
+			case IN_DEP_KNP:
+			case IN_PAS_KNP:
+				{
+					std::vector<std::string> lines;
+					if (!get_knp_pool()->parse(text, lines)) {
+						exit(-1);
+					}
 					sent.da_tool = sent.KNP;
 					sent.parse(lines);
-
 					break;
 				}
 			default:
@@ -584,9 +1441,41 @@ namespace modality {
 				exit(-1);
 		}
 
-#ifdef _MODEBUG
-		std::vector<std::string> matchedIDs;
-#endif
+		tag_parsed_sent(sent_orig, sent);
+		return true;
+	}
+
+
+	knp_pool *parser::get_knp_pool() {
+		if (knp == NULL) {
+			knp = new knp_pool(knp_command, knp_workers);
+		}
+		return knp;
+	}
+
+
+	/*
+	 * copy modality tags of the original tokens to the overlapping tokens of
+	 * the re-parsed sentence
+	 * Both token streams are in byte offset order, so the original tokens
+	 * that can overlap a parsed token are found by a window that only moves
+	 * forward, and each candidate is tested with the overlap conditions.
+	 */
+	void parser::tag_parsed_sent( const std::vector< t_token > &sent_orig, nlp::sentence &sent ) {
+		// attribute of each tag, in the order of nlp::MOD_SOURCE..MOD_FOCUS
+		static const char *eme2tag[nlp::MOD_TAG_NUM] = {
+			"source",
+			"time",
+			"conditional",
+			"pmtype",
+			"actuality",
+			"evaluation",
+			"focus"
+		};
+		std::vector<bool> matched(sent_orig.size(), false);
+		// first original token which may overlap the current parsed token
+		size_t lo = 0;
+
 		int sp = 0, ep = 0;
 		std::vector< nlp::chunk >::iterator it_chk;
 		std::vector< nlp::token >::iterator it_tok;
@@ -598,51 +1487,36 @@ namespace modality {
 #ifdef _MODEBUG
 				std::cout << it_tok->surf << "(" << sp << "," << ep << ")" << std::endl;
 #endif
-				
-				BOOST_FOREACH ( t_token tok, sent_orig ) {
-					if (
-							( tok.sp == sp && tok.ep == ep ) || 
+
+				// tokens of zero length are one byte off their neighbours
+				while (lo < sent_orig.size() && sent_orig[lo].ep < sp - 1) {
+					++lo;
+				}
+				for (size_t i=lo ; i<sent_orig.size() && sent_orig[i].sp <= ep + 1 ; ++i) {
+					const t_token &tok = sent_orig[i];
+					if (!(
+							( tok.sp == sp && tok.ep == ep ) ||
 							( tok.sp <= sp && ep <= tok.ep ) ||
 							( sp <= tok.sp && tok.sp <= ep ) ||
 							( sp <= tok.ep && tok.ep <= ep ) ||
 							( sp <= tok.sp && tok.ep <= ep )
-						 ) {
-						
-						if ( tok.eme.find("morphIDs") != tok.eme.end() ) {
-							nlp::t_eme::iterator it_eme;
-							for (it_eme=tok.eme.begin() ; it_eme!=tok.eme.end() ; ++it_eme) {
-								if (it_eme->first == "source") {
-									it_tok->mod.tag["source"] = it_eme->second;
-								}
-								else if (it_eme->first == "time") {
-									it_tok->mod.tag["tense"] = it_eme->second;
-								}
-								else if (it_eme->first == "conditional") {
-									it_tok->mod.tag["assumptional"] = it_eme->second;
-								}
-								else if (it_eme->first == "pmtype") {
-									it_tok->mod.tag["type"] = it_eme->second;
-								}
-								else if (it_eme->first == "actuality") {
-									it_tok->mod.tag["authenticity"] = it_eme->second;
-								}
-								else if (it_eme->first == "evaluation") {
-									it_tok->mod.tag["sentiment"] = it_eme->second;
-								}
-								else if (it_eme->first == "focus") {
-									it_tok->mod.tag["focus"] = it_eme->second;
-								}
-							}
+						 ) || tok.eme.find("morphIDs") == tok.eme.end() ) {
+						continue;
+					}
 
-							it_tok->mod.tids.push_back(it_tok->id);
-							it_tok->has_mod = true;
-							chk_has_mod = true;
-#ifdef _MODEBUG
-							std::cout << "found\t" << tok.orthToken << "(" << tok.morphID << ") - " << it_tok->surf << "(" << it_tok->id << ")" << std::endl;
-							matchedIDs.push_back(tok.morphID);
-#endif
+					for (unsigned int j=0 ; j<nlp::MOD_TAG_NUM ; ++j) {
+						nlp::t_eme::const_iterator it_eme = tok.eme.find(eme2tag[j]);
+						if (it_eme != tok.eme.end()) {
+							it_tok->mod.set(j, it_eme->second);
 						}
 					}
+					it_tok->mod.tids.push_back(it_tok->id);
+					it_tok->has_mod = true;
+					chk_has_mod = true;
+					matched[i] = true;
+#ifdef _MODEBUG
+					std::cout << "found\t" << tok.orthToken << "(" << tok.morphID << ") - " << it_tok->surf << "(" << it_tok->id << ")" << std::endl;
+#endif
 				}
 				ep++;
 				sort(it_tok->mod.tids.begin(), it_tok->mod.tids.end());
@@ -650,193 +1524,240 @@ namespace modality {
 			}
 			it_chk->has_mod = chk_has_mod;
 		}
-		
+
+		unsigned int n_events = 0;
+		std::vector< std::string > unmatched;
+		for (size_t i=0 ; i<sent_orig.size() ; ++i) {
+			if (sent_orig[i].eme.find("morphIDs") != sent_orig[i].eme.end()) {
+				n_events++;
+				if (!matched[i]) {
+					unmatched.push_back(sent_orig[i].morphID);
 #ifdef _MODEBUG
-		BOOST_FOREACH( t_token tok, sent_orig ) {
-			if ( tok.eme.find("morphIDs") != tok.eme.end() && std::find(matchedIDs.begin(), matchedIDs.end(), tok.morphID) == matchedIDs.end() ) {
-				std::cout << "not found\t" << tok.morphID << std::endl;
+					std::cout << "not found\t" << sent_orig[i].morphID << std::endl;
+#endif
+				}
 			}
 		}
-#endif
-		
-		return true;
+		boost::mutex::scoped_lock lock(align_mtx);
+		align_stats.events += n_events;
+		align_stats.unmatched += unmatched.size();
+		align_stats.unmatched_morph_ids.insert(align_stats.unmatched_morph_ids.end(), unmatched.begin(), unmatched.end());
 	}
 
 
-	std::vector<t_token> parser::parse_bccwj_sent(tinyxml2::XMLElement *elemSent, int *sp) {
-		std::vector<t_token> toks;
-		
-		if ( std::string(elemSent->Name()) == "sentence" || std::string(elemSent->Name()) == "quote" ) {
-			tinyxml2::XMLElement *elem = elemSent->FirstChildElement("SUW");
-			while (elem) {
-				if (std::string(elem->Name()) == "SUW") {
-					t_token tok;
-					tok.orthToken = elem->Attribute("orthToken");
-					tok.morphID = elem->Attribute("morphID");
-					tok.sp = *sp;
-					tok.ep = tok.sp + tok.orthToken.size() - 1;
-					toks.push_back(tok);
-					*sp = tok.ep + 1;
-				}
-				else if ( std::string(elem->Name()) == "sentence" || std::string(elem->Name()) == "quote" ) {
-					BOOST_FOREACH(t_token tok, parse_bccwj_sent(elem, sp)) {
-						toks.push_back(tok);
+	/*
+	 * Builds the token sequences of BCCWJ sentences from the events of
+	 * xml_reader.
+	 * The tokens are the SUW elements of a sentence element, including those
+	 * of sentence/quote elements nested after its first SUW. An eme:event
+	 * element that is a child of a child of the sentence container (webLine
+	 * or mergedSample) tags the tokens of its morphID in that child and in the
+	 * sentences before it in the container, which are found through an index
+	 * of morphIDs instead of scanning the tokens.
+	 */
+	class bccwj_handler : public xml_handler {
+		public:
+			// sentences of OCQuestion or mergedSample
+			std::vector< std::vector< t_token > > sents_q;
+			// sentences of OCAnswer
+			std::vector< std::vector< t_token > > sents_a;
+
+		private:
+			enum {
+				E_IGNORE,
+				E_ROOT,
+				E_PART,
+				E_CONTAINER,
+				E_CHILD,
+				E_SENT_TOP,
+				E_SENT
+			};
+			typedef struct {
+				int role;
+				bool seen_suw;
+			} t_frame;
+
+			bool is_oc;
+			bool seen_q, seen_a;
+			std::vector< t_frame > frames;
+			std::vector< std::vector< t_token > > *out;
+			int sp;
+			// morphID -> (sentence, token) in out, for the current container
+			boost::unordered_map< std::string, std::vector< std::pair<size_t, size_t> > > morph_index;
+			// events of the open top sentence, applied when it is closed
+			std::vector< t_xml_attrs > pending;
+
+		public:
+			bccwj_handler(bool _is_oc) {
+				is_oc = _is_oc;
+				seen_q = false;
+				seen_a = false;
+				out = &sents_q;
+				sp = 0;
+			}
+
+			void start_element(const std::string &name, const t_xml_attrs &attrs) {
+				int parent = frames.empty() ? -1 : frames.back().role;
+				t_frame frame;
+				frame.role = E_IGNORE;
+				frame.seen_suw = false;
+
+				if (parent == -1) {
+					if (is_oc && name == "sample") {
+						frame.role = E_ROOT;
+					}
+					else if (!is_oc && name == "mergedSample") {
+						frame.role = E_CONTAINER;
+						morph_index.clear();
+					}
+				}
+				else if (parent == E_ROOT) {
+					if (name == "OCQuestion" && !seen_q) {
+						seen_q = true;
+						out = &sents_q;
+						frame.role = E_PART;
+					}
+					else if (name == "OCAnswer" && !seen_a) {
+						seen_a = true;
+						out = &sents_a;
+						frame.role = E_PART;
+					}
+				}
+				else if (parent == E_PART) {
+					if (name == "webLine") {
+						frame.role = E_CONTAINER;
+						morph_index.clear();
+					}
+				}
+				else if (parent == E_CONTAINER) {
+					if (name == "sentence") {
+						frame.role = E_SENT_TOP;
+						out->push_back(std::vector< t_token >());
+						sp = 0;
+						pending.clear();
+					}
+					else {
+						frame.role = E_CHILD;
+					}
+				}
+				else if (parent == E_CHILD) {
+					if (name == "eme:event") {
+						apply_event(attrs);
+					}
+				}
+				else if (parent == E_SENT_TOP || parent == E_SENT) {
+					t_frame &parent_frame = frames.back();
+					if (name == "eme:event" && parent == E_SENT_TOP) {
+						pending.push_back(attrs);
+					}
+					else if (name == "SUW") {
+						parent_frame.seen_suw = true;
+						add_token(attrs);
+					}
+					// elements before the first SUW are not read
+					else if ((name == "sentence" || name == "quote") && parent_frame.seen_suw) {
+						frame.role = E_SENT;
 					}
 				}
-				elem = elem->NextSiblingElement();
+				frames.push_back(frame);
 			}
-		}
-		
-		return toks;
-	}
 
+			void end_element(const std::string &) {
+				if (frames.empty()) {
+					return;
+				}
+				if (frames.back().role == E_SENT_TOP) {
+					BOOST_FOREACH (const t_xml_attrs &attrs, pending) {
+						apply_event(attrs);
+					}
+					pending.clear();
+				}
+				frames.pop_back();
+			}
 
-	std::vector< std::vector< t_token > > parser::parse_OC_sents (tinyxml2::XMLElement *elem) {
-		std::vector< std::vector<t_token> > sents;
-		
-		tinyxml2::XMLElement *elemWL = elem->FirstChildElement("webLine");
-		while (elemWL) {
-			if (std::string(elemWL->Name()) == "webLine") {
-				tinyxml2::XMLElement *elem = elemWL->FirstChildElement("sentence");
-				while (elem) {
-					if (std::string(elem->Name()) == "sentence") {
-						int sp = 0;
-						std::vector<t_token> sent = parse_bccwj_sent(elem, &sp);
-						parse_modtag_for_sent(elem, &sent);
-						sents.push_back(sent);
+		private:
+			static const std::string *find_attr(const t_xml_attrs &attrs, const char *name) {
+				for (t_xml_attrs::const_iterator it=attrs.begin() ; it!=attrs.end() ; ++it) {
+					if (it->first == name) {
+						return &it->second;
 					}
-					elem = elem->NextSiblingElement();
 				}
+				return NULL;
 			}
-			elemWL = elemWL->NextSiblingElement();
-		}
-		
-		return sents;
-	}
 
+			void add_token(const t_xml_attrs &attrs) {
+				t_token tok;
+				const std::string *orth = find_attr(attrs, "orthToken");
+				const std::string *morph_id = find_attr(attrs, "morphID");
+				if (orth != NULL) {
+					tok.orthToken = *orth;
+				}
+				if (morph_id != NULL) {
+					tok.morphID = *morph_id;
+				}
+				tok.sp = sp;
+				tok.ep = tok.sp + tok.orthToken.size() - 1;
+				sp = tok.ep + 1;
 
-	void parser::parse_modtag_for_sent(tinyxml2::XMLElement *elemSent, std::vector< t_token > *sent) {
-		boost::regex reg_or("OR");
-		boost::smatch m;
-
-		while (elemSent) {
-			tinyxml2::XMLElement *elemEME = elemSent->FirstChildElement("eme:event");
-			while (elemEME) {
-				if (std::string(elemEME->Name()) == "eme:event") {
-					// event tag which has required tags, does not contain "OR" in morphIDs
-					if (elemEME->Attribute("eme:orthTokens") &&
-							elemEME->Attribute("eme:morphIDs") &&
-							boost::regex_search(std::string(elemEME->Attribute("eme:morphIDs")), m, reg_or) == false )
-					{
-						bool use = true;
-						if (elemEME->Attribute("eme:pseudo")) {
-							std::string pseudo = elemEME->Attribute("eme:pseudo");
-							if (pseudo == "機能語" || pseudo == "副詞" || pseudo == "連体詞" || pseudo == "名詞" || pseudo == "感嘆詞" || pseudo == "比況" || pseudo == "解析誤り") {
-								use = false;
-							}
-							else if (pseudo == "名詞-事象可能") {
-								use = false;
-							}
-						}
+				std::vector< t_token > &sent = out->back();
+				morph_index[tok.morphID].push_back(std::make_pair(out->size()-1, sent.size()));
+				sent.push_back(tok);
+			}
 
-						if (use) {
-							std::string orthToken = elemEME->Attribute("eme:orthTokens");
-							std::vector<std::string> buf;
-							boost::algorithm::split(buf, orthToken, boost::algorithm::is_any_of(","));
-							orthToken = buf[0];
-
-							std::string morphID = elemEME->Attribute("eme:morphIDs");
-							boost::algorithm::split(buf, morphID, boost::algorithm::is_any_of(","));
-							morphID = buf[buf.size()-1];
-
-							std::vector< t_token >::iterator it_tok;
-							for (it_tok=sent->begin() ; it_tok!=sent->end() ; ++it_tok) {
-								if (it_tok->morphID == morphID) {
-									const tinyxml2::XMLAttribute *attr = elemEME->FirstAttribute();
-									while (attr) {
-										std::string attr_name = attr->Name();
-										boost::algorithm::split(buf, attr_name, boost::algorithm::is_any_of(":"));
-										attr_name = buf[buf.size()-1];
-
-										it_tok->eme[attr_name] = std::string(attr->Value());
-										attr = attr->Next();
-									}
-								}
-							}
-						}
+			void apply_event(const t_xml_attrs &attrs) {
+				// event tag which has required tags, does not contain "OR" in morphIDs
+				const std::string *morph_ids = find_attr(attrs, "eme:morphIDs");
+				if (find_attr(attrs, "eme:orthTokens") == NULL || morph_ids == NULL || morph_ids->find("OR") != std::string::npos) {
+					return;
+				}
+				const std::string *pseudo = find_attr(attrs, "eme:pseudo");
+				if (pseudo != NULL) {
+					if (*pseudo == "機能語" || *pseudo == "副詞" || *pseudo == "連体詞" || *pseudo == "名詞" || *pseudo == "感嘆詞" || *pseudo == "比況" || *pseudo == "解析誤り") {
+						return;
+					}
+					else if (*pseudo == "名詞-事象可能") {
+						return;
 					}
 				}
-				elemEME = elemEME->NextSiblingElement();
-			}
-			elemSent = elemSent->NextSiblingElement();
-		}
 
-#ifdef _MODEBUG
-		std::vector<std::string> attrs;
-		attrs.push_back("source");
-		attrs.push_back("time");
-		attrs.push_back("conditional");
-		attrs.push_back("pmtype");
-		attrs.push_back("actuality");
-		attrs.push_back("evaluation");
-		BOOST_FOREACH( t_token tok, *sent ) {
-			std::cout << tok.orthToken << " " << tok.morphID << " (" << tok.sp << "," << tok.ep << ")";
-			boost::unordered_map< std::string, std::string >::iterator it;
-
-			if (tok.eme.find("morphIDs") != tok.eme.end()) {
-				std::cout << " " << tok.eme["morphIDs"];
-				BOOST_FOREACH (std::string attr, attrs) {
-					if (tok.eme.find(attr) != tok.eme.end()) {
-						std::cout << " " << tok.eme[attr];
+				std::string morph_id = morph_ids->substr(morph_ids->rfind(',') + 1);
+				boost::unordered_map< std::string, std::vector< std::pair<size_t, size_t> > >::iterator it_idx = morph_index.find(morph_id);
+				if (it_idx == morph_index.end()) {
+					return;
+				}
+				std::vector< std::pair<size_t, size_t> >::iterator it_pos;
+				for (it_pos=it_idx->second.begin() ; it_pos!=it_idx->second.end() ; ++it_pos) {
+					t_token &tok = (*out)[it_pos->first][it_pos->second];
+					for (t_xml_attrs::const_iterator it=attrs.begin() ; it!=attrs.end() ; ++it) {
+						tok.eme[it->first.substr(it->first.rfind(':') + 1)] = it->second;
 					}
 				}
 			}
-			std::cout << std::endl;
-		}
-#endif
-	}
+	};
 
 
 	/*
 	 * Convert modality-tagged OC xml into feature structure for ML
 	 */
 	std::vector< std::vector< t_token > > parser::parse_OC(std::string xml_path) {
-		tinyxml2::XMLDocument doc;
-		doc.LoadFile(xml_path.c_str());
-		
-		tinyxml2::XMLElement *elemQ = doc.FirstChildElement("sample")->FirstChildElement("OCQuestion");
-		tinyxml2::XMLElement *elemA = doc.FirstChildElement("sample")->FirstChildElement("OCAnswer");
-		std::vector< std::vector<t_token> > sentsQ;
-		std::vector< std::vector<t_token> > sentsA;
-		
-		sentsQ = parse_OC_sents( elemQ );
-//		parse_OC_modtag( elemQ, &sentsQ);
-		sentsA = parse_OC_sents( elemA );
-//		parse_OC_modtag( elemA, &sentsA);
-		
-		sentsQ.insert(sentsQ.end(), sentsA.begin(), sentsA.end());
-	
-		return sentsQ;
+		bccwj_handler handler(true);
+		xml_reader reader;
+		reader.parse_file(xml_path, handler);
+
+		std::vector< std::vector< t_token > > sents;
+		sents.swap(handler.sents_q);
+		sents.insert(sents.end(), handler.sents_a.begin(), handler.sents_a.end());
+		return sents;
 	}
 
 
 	std::vector< std::vector< t_token > > parser::parse_OW_PB_PN(std::string xml_path) {
-		tinyxml2::XMLDocument doc;
-		doc.LoadFile(xml_path.c_str());
-		
-		tinyxml2::XMLElement *elem = doc.FirstChildElement("mergedSample");
-		tinyxml2::XMLElement *elemSent = elem->FirstChildElement("sentence");
-		std::vector< std::vector<t_token> > sents;
-		while (elemSent) {
-			if (std::string(elemSent->Name()) == "sentence") {
-				int sp = 0;
-				std::vector<t_token> sent = parse_bccwj_sent(elemSent, &sp);
-				parse_modtag_for_sent(elemSent, &sent);
-				sents.push_back(sent);
-			}
-			elemSent = elemSent->NextSiblingElement();
-		}
-		
+		bccwj_handler handler(false);
+		xml_reader reader;
+		reader.parse_file(xml_path, handler);
+
+		std::vector< std::vector< t_token > > sents;
+		sents.swap(handler.sents_q);
 		return sents;
 	}
 
@@ -877,7 +1798,16 @@ namespace modality {
 		ofs_dump.close();
 	}
 			
+	// a hashed model keeps the bits of its buckets instead of the dictionary
 	void parser::save_f2i() {
+		if (feature_hash_bits > 0) {
+			std::ofstream ofs(feature_hash_path.string().c_str());
+			ofs << feature_hash_bits << std::endl;
+			boost::filesystem::remove(f2i_path);
+			boost::filesystem::remove(f2id_path);
+			return;
+		}
+		boost::filesystem::remove(feature_hash_path);
 		save_cdb( f2i.map, f2i_path, f2id_path );
 	}
 
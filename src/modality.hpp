@@ -7,9 +7,9 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 //#include <mecab.h>
 #include <cabocha.h>
-#include "../tinyxml2/tinyxml2.h"
 
 namespace linear {
 #define Malloc(type,n) (type *)malloc((n)*sizeof(type))
@@ -17,7 +17,12 @@ namespace linear {
 };
 
 #include "sentence.hpp"
+#include "stats.hpp"
 #include "cdbmap.hpp"
+#include "feature_matrix.hpp"
+#include "knp_pool.hpp"
+#include "packed_corpus.hpp"
+#include "pos_matcher.hpp"
 #include "../config.h"
 
 #ifndef PACKAGE_VERSION
@@ -53,7 +58,8 @@ namespace modality {
 		IN_PAS_SYN = 3,
 		IN_PAS_KNP = 4,
 		IN_XML_CAB = 5,
-		IN_XML_KNP = 6
+		IN_XML_KNP = 6,
+		IN_NUM = 7  // number of input layers
 	};
 
 	enum {
@@ -92,15 +98,89 @@ namespace modality {
 		std::string semrel;
 	} t_match_func;
 		
+	// alignment of the original tokens with modality tags to parsed tokens
+	typedef struct {
+		unsigned int events;
+		unsigned int unmatched;
+		std::vector< std::string > unmatched_morph_ids;
+	} t_align_stats;
+
+	// a sentence of a packed corpus
+	typedef struct {
+		const packed_corpus_reader *pack;
+		size_t record;
+	} t_pack_record;
+
+	// a prediction of analyze(), recorded for zunda-diff and --scores;
+	// feat_str is filled when decision_features is set
+	typedef struct {
+		unsigned int tok_id;
+		unsigned int tag;
+		int label;
+		std::vector< double > values;
+		std::string feat_str;
+	} t_decision;
+
+	/*
+	 * Input files shared by the loader threads. Files are taken one by one as
+	 * threads become free, and the sentences of each file are kept at its
+	 * index so that the loaded data is in the order of the files.
+	 * When records is set, an entry whose pack is not NULL is a sentence of a
+	 * packed corpus instead of a file.
+	 */
+	class load_queue {
+		public:
+			const std::vector< std::string > *paths;
+			const std::vector< t_pack_record > *records;
+			int input_layer;
+			std::vector< std::vector< nlp::sentence > > docs;
+		private:
+			unsigned int next;
+			boost::mutex mtx;
+
+		public:
+			load_queue(const std::vector< std::string > *_paths, int _input_layer) {
+				paths = _paths;
+				records = NULL;
+				input_layer = _input_layer;
+				docs.resize(paths->size());
+				next = 0;
+			}
+
+			bool pop(unsigned int *i) {
+				boost::mutex::scoped_lock lock(mtx);
+				if (next >= paths->size()) {
+					return false;
+				}
+				*i = next++;
+				// a packed corpus is named once, at its first sentence
+				const std::string &name = (*paths)[*i];
+				if (records == NULL || (*records)[*i].pack == NULL) {
+					std::cout << name << std::endl;
+				}
+				else if ((*records)[*i].record == 0) {
+					std::cout << name.substr(0, name.rfind('#')) << std::endl;
+				}
+				return true;
+			}
+	};
+
+
+	class feature_generator2;
+
 	class parser {
 		public:
 			cdbpp::cdbpp dbr_ttj;
 			cdbpp::cdbpp dbr_fadic;
+			boost::filesystem::path dic_path;
 
 //			MeCab::Tagger *mecab;
 			CaboCha::Parser *cabocha;
 			
 			std::vector< nlp::sentence > learning_data;
+			// sentences learned in place of learning_data when not empty, as
+			// the folds of the cross validation share one corpus; only read
+			std::vector< nlp::sentence* > learning_refs;
 			unsigned int target_detection;
 			
 //			boost::unordered_map< std::string, int > label2id;
@@ -119,17 +199,78 @@ namespace modality {
 			CdbMap<std::string, int> f2i;
 			boost::filesystem::path f2i_path;
 			boost::filesystem::path f2id_path;
+			// features are hashed into 2^feature_hash_bits buckets instead of
+			// being looked up in f2i when it is not 0; a hashed model has the
+			// bits in feature_hash_path and no feat2id.cdb
+			int feature_hash_bits;
+			boost::filesystem::path feature_hash_path;
+			// false when set_model_dir() found an invalid feature_hash file;
+			// load_models() then fails
+			bool model_dir_ok;
+			static const int FEATURE_HASH_MAX_BITS = 24;
 
 			linear::model *models[LABEL_NUM];
 			bool model_loaded;
+			// nlp::mod_labels id of each label id the models predict, or -1
+			std::vector<int> pred_labels;
+			// logistic regression of DETECT_BY_ML over the tokens the POS sets
+			// detect; a token is a target when its probability of being an
+			// event is target_threshold or more
+			linear::model *target_model;
+			boost::filesystem::path target_model_path;
+			int target_event_idx;
+			double target_threshold;
+			// cascade: the fast model of a tag, learned from the features
+			// made without dictionary lookups, decides when its margin is
+			// cascade_threshold or more, and the full model decides otherwise
+			bool cascade;
+			double cascade_threshold;
+			linear::model *fast_models[LABEL_NUM];
+			boost::filesystem::path fast_model_path[LABEL_NUM];
+			// predictions decided by the fast models and by the full models
+			unsigned long cascade_preds[2];
+			// threads used by liblinear to train each model
+			int train_threads;
+			// threads used to load input data
+			unsigned int load_threads;
+			// liblinear solver and cost of each tag
+			int solver_type[LABEL_NUM];
+			double cost[LABEL_NUM];
 			std::vector<unsigned int> analyze_tags;
+			t_align_stats align_stats;
+			boost::mutex align_mtx;
+			// juman/knp processes to parse KNP input layers, started on first use
+			std::string knp_command;
+			unsigned int knp_workers;
+			knp_pool *knp;
+			// predictions of analyze() are appended here when set
+			std::vector< t_decision > *decisions;
+			// also record the features of each prediction
+			bool decision_features;
 
 			std::string use_feats_str[LABEL_NUM];
 			std::vector<std::string> use_feats[LABEL_NUM];
+			// features of the target detector
+			std::vector<std::string> target_feats;
+			// features of the fast models of the cascade
+			std::vector<std::string> fast_feats[LABEL_NUM];
+			// whether the features of a tag include fadic_*
+			bool use_fadic[LABEL_NUM];
+			// tags whose predictions the features of a tag are made of
+			std::vector<unsigned int> tag_deps[LABEL_NUM];
 			
 			int pos_tag;
 			std::vector< std::vector< std::vector<std::string> > > target_pos;
 			int max_num_tok_target;
+			// target_pos compiled by set_pos_tag()
+			pos_matcher target_matcher;
+			// compare target_pos as strings instead of with target_matcher,
+			// as zunda-diff does to check the matcher
+			bool match_pos_strings;
+			// the targets of a sentence share the strings of its chunks
+			// (chunk_cache); off, each target makes its own, as zunda-diff
+			// does to check the cache
+			bool use_chunk_cache;
 			
 			parser(std::string model_dir = MODELDIR_IPA, std::string dic_dir = DICDIR) {
 				analyze_tags.push_back(TENSE);
@@ -147,8 +288,35 @@ namespace modality {
 
 				BOOST_FOREACH (unsigned int i, analyze_tags) {
 					boost::algorithm::split(use_feats[i], use_feats_str[i], boost::algorithm::is_any_of(","));
+					use_fadic[i] = false;
+					BOOST_FOREACH (const std::string &cat, use_feats[i]) {
+						if (cat.compare(0, 6, "fadic_") == 0) {
+							use_fadic[i] = true;
+						}
+						if (cat == "tok" || cat == "func_surf" || cat == "mod_type") {
+							fast_feats[i].push_back(cat);
+						}
+					}
+				}
+
+				// fadic_* looks up the tense of the token and the authenticity
+				// of the token of its head chunk, and mod_type of authenticity
+				// is the type of the token; mod_type of tense and assumptional
+				// is always empty as they are analyzed before authenticity
+				BOOST_FOREACH (unsigned int i, analyze_tags) {
+					if (use_fadic[i]) {
+						tag_deps[i].push_back(TENSE);
+						tag_deps[i].push_back(AUTHENTICITY);
+					}
 				}
+				tag_deps[AUTHENTICITY].push_back(TYPE);
+				target_feats.push_back("target");
 
+				for (unsigned int i=0 ; i<LABEL_NUM ; ++i) {
+					models[i] = NULL;
+					fast_models[i] = NULL;
+				}
+				target_model = NULL;
 				model_path = new boost::filesystem::path[LABEL_NUM];
 				feat_path = new boost::filesystem::path[LABEL_NUM];
 				set_model_dir(model_dir);
@@ -157,6 +325,7 @@ namespace modality {
 				//				
 				std::ifstream ifs_db;
 				boost::filesystem::path dic_dir_path(dic_dir);
+				dic_path = dic_dir_path;
 				boost::filesystem::path ttj_path("ttjcore2seq.cdb");
 				ttj_path = dic_dir_path / ttj_path;
 				ifs_db.open(ttj_path.string().c_str(), std::ios_base::binary);
@@ -180,6 +349,8 @@ namespace modality {
 				cabocha = CaboCha::createParser("-f1");
 				
 				target_detection = DETECT_BY_POS;
+				match_pos_strings = false;
+				use_chunk_cache = true;
 				pos_tag = POS_IPA;
 				set_pos_tag(pos_tag, "");
 				
@@ -187,16 +358,32 @@ namespace modality {
 				open_l2i_cdb();
 
 				model_loaded = false;
+				target_event_idx = 0;
+				target_threshold = 0.5;
+				cascade = false;
+				cascade_threshold = 1.0;
+				cascade_preds[0] = 0;
+				cascade_preds[1] = 0;
+				train_threads = 1;
+				load_threads = 1;
+				align_stats.events = 0;
+				align_stats.unmatched = 0;
+				knp_command = "juman | knp -tab";
+				knp_workers = 1;
+				knp = NULL;
+				decisions = NULL;
+				decision_features = false;
+				for (unsigned int i=0 ; i<LABEL_NUM ; ++i) {
+					solver_type[i] = linear::L2R_LR;
+					cost[i] = 1.0;
+				}
 			}
 
 			~parser() {
+				delete knp;
 //				delete [] model_path;
 //				delete [] feat_path;
-				if (model_loaded) {
-					BOOST_FOREACH (unsigned int i, analyze_tags) {
-//						linear::free_and_destroy_model(&models[i]);
-					}
-				}
+				free_models();
 			}
 
 		public:
@@ -206,6 +393,7 @@ namespace modality {
 			unsigned int detect_format(std::string);
 			unsigned int detect_format(std::vector<std::string>);
 			bool detect_target(nlp::token &, nlp::sentence &);
+			bool match_target_pos(nlp::token &, nlp::sentence &);
 
 			bool parse_pos_str(const std::string &t_pos, std::vector< std::vector< std::vector<std::string> > > *t_pos_vec, int *_max_num_tok_target) {
 				*_max_num_tok_target = 0;
@@ -232,7 +420,7 @@ namespace modality {
 				return true;
 			}
 
-			void set_pos_tag(int _pos_tag, const std::string &_pos_set) {
+			bool set_pos_tag(int _pos_tag, const std::string &_pos_set) {
 				pos_tag = _pos_tag;
 				std::string t_pos;
 				switch (pos_tag) {
@@ -246,34 +434,63 @@ namespace modality {
 						break;
 					default:
 						std::cerr << "ERROR: invalid pos tag" << std::endl;
-						break;
+						return false;
 				}
 				if (!_pos_set.empty())
 					t_pos = _pos_set;
 				parse_pos_str(t_pos, &target_pos, &max_num_tok_target);
+				return target_matcher.compile(target_pos, max_num_tok_target);
 			}
 
+			bool set_analyze_tags(const std::string &);
 			bool load_models(boost::filesystem::path *);
 			bool load_models();
+			void free_models();
 			bool analyze(const std::string &, const int, nlp::sentence &);
 			bool analyze(nlp::sentence &);
 			bool analyzeToString(nlp::sentence &, std::string &);
 			bool analyzeToString(const std::string &, const int, std::string &);
 			void pack_feat_linear(t_feat &, linear::feature_node *);
+			void pack_feat_hashed(t_feat &, linear::feature_node *);
+			int feature_dim();
+			void add_mem_components();
+			void sample_memo_maps(size_t);
 //			bool parse(std::string);
 			void load_xmls(std::vector< std::string >, int);
 			void load_deppasmods(std::vector< std::string >, int);
+			void open_deppasmods(const std::vector< std::string > &, std::vector< std::string > &, std::vector< t_pack_record > &, std::vector< packed_corpus_reader* > &);
+			void run_loaders(load_queue &, void (parser::*)(load_queue *));
+			void load_xml_worker(load_queue *);
+			void load_deppasmod_worker(load_queue *);
+			void load_deppasmod(const std::string &, int, nlp::sentence &);
+			void load_deppasmod(const std::string &, std::istream &, int, nlp::sentence &);
 			void learn(boost::filesystem::path *, boost::filesystem::path *);
 			void learn();
+			void learn_target();
+			std::vector< nlp::sentence* > learning_sentences();
+			template <typename M> void extract_target_features(nlp::sentence &, M *);
+			void train_target_model(linear::problem *);
+			double target_probability(nlp::token &, nlp::sentence &);
+			bool predict_fast(unsigned int, feature_generator2 &, unsigned int, int *);
+			void extract_features(feature_matrix *, feature_matrix * = NULL);
+			template <typename M> void extract_features(nlp::sentence &, std::ofstream *, M *, M * = NULL);
+			void learn_stream(const std::vector< std::string > &, int, const boost::filesystem::path &);
+			void train_models(feature_matrix *, bool = false);
+			void train_problems(linear::problem *, bool = false);
+			void train_model(linear::problem *, unsigned int, bool);
+			bool save_features(const boost::filesystem::path &, feature_matrix *);
+			bool load_features(const boost::filesystem::path &, feature_matrix *);
+			bool check_feature_ids(feature_matrix *);
+			static bool read_feature_hash(const boost::filesystem::path &, int *);
 
 			nlp::sentence make_tagged_ipasents( std::vector< t_token >, int );
 			bool make_tagged_ipasents( std::vector< t_token >, int, nlp::sentence & );
+			bool make_tagged_ipasents( const std::vector< t_token > &, int, nlp::sentence &, CaboCha::Parser * );
+			knp_pool *get_knp_pool();
+			void tag_parsed_sent( const std::vector< t_token > &, nlp::sentence & );
 
 			std::vector< std::vector< t_token > > parse_OC(std::string);
 			std::vector< std::vector< t_token > > parse_OW_PB_PN(std::string);
-			std::vector< std::vector< t_token > > parse_OC_sents (tinyxml2::XMLElement *);
-			std::vector<t_token> parse_bccwj_sent(tinyxml2::XMLElement *, int *);
-			void parse_modtag_for_sent(tinyxml2::XMLElement *, std::vector< t_token > *);
 
 			void open_f2i_cdb();
 			void open_l2i_cdb();
@@ -283,27 +500,57 @@ namespace modality {
 			void save_i2l();
 	};
 
+	/*
+	 * Strings of the chunks of a sentence that the features of its targets
+	 * are made of, built on first use and shared by all the targets of the
+	 * sentence: the dependency features of a chunk as a destination, and
+	 * the surfaces following each token of a chunk for func_surf.
+	 */
+	class chunk_cache {
+		private:
+			const nlp::sentence *sent;
+			std::vector< std::vector<std::string> > dst_feats;
+			std::vector< std::vector<std::string> > suffixes;
+
+		public:
+			chunk_cache(const nlp::sentence *_sent) {
+				sent = _sent;
+				dst_feats.resize(sent->chunks.size());
+				suffixes.resize(sent->chunks.size());
+			}
+
+			// NULL for a chunk not of the sentence
+			const std::vector<std::string> *dst_chunk_feats(const nlp::chunk &);
+			const std::string *func_suffix(const nlp::chunk &, const nlp::token &);
+			static void make_dst_feats(const nlp::chunk &, std::vector<std::string> &);
+			static void make_suffixes(const nlp::chunk &, std::vector<std::string> &);
+	};
+
 	class feature_generator2 {
 		public:
 			nlp::token *tok_core;
 			nlp::chunk *chk_core;
 			nlp::sentence *sent;
 			t_feat_cat feat_cat;
+			// shared by the generators of the targets of the sentence when set
+			chunk_cache *cache;
 		public:
-			feature_generator2(nlp::sentence *_sent, nlp::chunk *chk, nlp::token *tok) {
+			feature_generator2(nlp::sentence *_sent, nlp::chunk *chk, nlp::token *tok, chunk_cache *_cache = NULL) {
 				sent = _sent;
 				tok_core = tok;
 				chk_core = chk;
+				cache = _cache;
 			}
 		public:
 			bool compile_feat_str( const std::vector<std::string> &, std::string & );
 			bool compile_feat( const std::vector<std::string> &, t_feat & );
 			void gen_feature_function();
-			void gen_feature_mod(const std::string &);
+			void gen_feature_mod(unsigned int);
 			void gen_feature_basic(const int);
 			void gen_feature_dst_chunks();
 			void gen_feature_ttj(cdbpp::cdbpp *);
 			void gen_feature_fadic(cdbpp::cdbpp *);
+			void gen_feature_target();
 			/*
 			void gen_feature_last_pred();
 			void gen_feature_dst_chunks(const unsigned int);
@@ -0,0 +1,274 @@
+#ifndef __PACKED_CORPUS_HPP__
+#define __PACKED_CORPUS_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../config.h"
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+namespace modality {
+	/*
+	 * Many sentences in one file with an offset index at its end, so that a
+	 * reader maps the file and reaches any sentence without scanning the rest.
+	 *
+	 * Binary file layout (native byte order):
+	 *   "ZPC1", uint32 flags, uint64 records, uint64 index offset,
+	 *   records times (uint32 id length, id, text),
+	 *   records times (uint64 record offset, uint32 stored text size, uint32 text length)
+	 * where the text is the content of a .depmod file, deflated when flags has
+	 * PACK_ZLIB.
+	 */
+	enum {
+		PACK_ZLIB = 1
+	};
+
+	const size_t PACK_HEADER_SIZE = 4 + 4 + 8 + 8;
+	// deflate never expands data more than 1032 times, so a larger text length
+	// in the index is broken
+	const uint64_t PACK_MAX_RATIO = 1032;
+
+
+	class packed_corpus_writer {
+		private:
+			std::ofstream ofs;
+			uint32_t flags;
+			uint64_t offset;
+			std::vector< uint64_t > offsets;
+			std::vector< uint32_t > stored_sizes;
+			std::vector< uint32_t > lengths;
+
+		public:
+			packed_corpus_writer() {
+				flags = 0;
+				offset = 0;
+			}
+
+			~packed_corpus_writer() {
+				if (ofs.is_open()) {
+					close();
+				}
+			}
+
+			static bool compression_available() {
+#ifdef HAVE_LIBZ
+				return true;
+#else
+				return false;
+#endif
+			}
+
+			bool open(const std::string &path, bool compress) {
+				if (compress && !compression_available()) {
+					std::cerr << "ERROR: zunda is built without zlib" << std::endl;
+					return false;
+				}
+				flags = compress ? PACK_ZLIB : 0;
+				offsets.clear();
+				stored_sizes.clear();
+				lengths.clear();
+				ofs.open(path.c_str(), std::ios_base::binary);
+				if (!ofs) {
+					return false;
+				}
+				// the counts are filled in by close()
+				char header[PACK_HEADER_SIZE];
+				memset(header, 0, sizeof(header));
+				memcpy(header, "ZPC1", 4);
+				ofs.write(header, sizeof(header));
+				offset = PACK_HEADER_SIZE;
+				return ofs.good();
+			}
+
+			size_t size() const {
+				return offsets.size();
+			}
+
+			bool add(const std::string &id, const std::string &text) {
+				std::string stored;
+				if (flags & PACK_ZLIB) {
+#ifdef HAVE_LIBZ
+					uLongf dest_len = compressBound(text.size());
+					stored.resize(dest_len);
+					if (compress2((Bytef *)&stored[0], &dest_len, (const Bytef *)text.data(), text.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+						return false;
+					}
+					stored.resize(dest_len);
+#endif
+				}
+				else {
+					stored = text;
+				}
+
+				uint32_t id_len = id.size();
+				ofs.write((const char *)&id_len, sizeof(id_len));
+				ofs.write(id.data(), id_len);
+				ofs.write(stored.data(), stored.size());
+
+				offsets.push_back(offset);
+				stored_sizes.push_back(stored.size());
+				lengths.push_back(text.size());
+				offset += sizeof(id_len) + id_len + stored.size();
+				return ofs.good();
+			}
+
+			bool close() {
+				uint64_t n_records = offsets.size();
+				uint64_t index_offset = offset;
+				for (size_t i=0 ; i<offsets.size() ; ++i) {
+					ofs.write((const char *)&offsets[i], sizeof(offsets[i]));
+					ofs.write((const char *)&stored_sizes[i], sizeof(stored_sizes[i]));
+					ofs.write((const char *)&lengths[i], sizeof(lengths[i]));
+				}
+				ofs.seekp(4);
+				ofs.write((const char *)&flags, sizeof(flags));
+				ofs.write((const char *)&n_records, sizeof(n_records));
+				ofs.write((const char *)&index_offset, sizeof(index_offset));
+				bool ok = ofs.good();
+				ofs.close();
+				return ok;
+			}
+	};
+
+
+	/*
+	 * A packed corpus mapped read-only into memory. read() does not modify the
+	 * reader, so that threads can read records of one reader at the same time.
+	 */
+	class packed_corpus_reader {
+		private:
+			const char *addr;
+			size_t length;
+			uint32_t flags;
+			uint64_t n_records;
+			const char *index;
+
+		public:
+			packed_corpus_reader() {
+				addr = NULL;
+				length = 0;
+				flags = 0;
+				n_records = 0;
+				index = NULL;
+			}
+
+			~packed_corpus_reader() {
+				close();
+			}
+
+			// whether the file starts with the magic of a packed corpus
+			static bool is_packed(const std::string &path) {
+				std::ifstream ifs(path.c_str(), std::ios_base::binary);
+				char magic[4];
+				return ifs.read(magic, 4) && memcmp(magic, "ZPC1", 4) == 0;
+			}
+
+			bool open(const std::string &path) {
+				close();
+				int fd = ::open(path.c_str(), O_RDONLY);
+				if (fd < 0) {
+					return false;
+				}
+				struct stat st;
+				if (fstat(fd, &st) != 0 || (size_t)st.st_size < PACK_HEADER_SIZE) {
+					::close(fd);
+					return false;
+				}
+				length = st.st_size;
+				void *p = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+				::close(fd);
+				if (p == MAP_FAILED) {
+					length = 0;
+					return false;
+				}
+				addr = (const char *)p;
+
+				uint64_t index_offset;
+				memcpy(&flags, addr + 4, sizeof(flags));
+				memcpy(&n_records, addr + 8, sizeof(n_records));
+				memcpy(&index_offset, addr + 16, sizeof(index_offset));
+				if (memcmp(addr, "ZPC1", 4) != 0 || index_offset > length || (length - index_offset) / index_entry_size() < n_records) {
+					close();
+					return false;
+				}
+#ifndef HAVE_LIBZ
+				if (flags & PACK_ZLIB) {
+					std::cerr << "ERROR: " << path << " is compressed, but zunda is built without zlib" << std::endl;
+					close();
+					return false;
+				}
+#endif
+				index = addr + index_offset;
+				return true;
+			}
+
+			void close() {
+				if (addr != NULL) {
+					munmap((void *)addr, length);
+					addr = NULL;
+				}
+				length = 0;
+				n_records = 0;
+				index = NULL;
+			}
+
+			size_t size() const {
+				return n_records;
+			}
+
+			bool read(size_t i, std::string &id, std::string &text) const {
+				if (i >= n_records) {
+					return false;
+				}
+				uint64_t offset;
+				uint32_t stored_size, text_len, id_len;
+				const char *entry = index + i * index_entry_size();
+				memcpy(&offset, entry, sizeof(offset));
+				memcpy(&stored_size, entry + 8, sizeof(stored_size));
+				memcpy(&text_len, entry + 12, sizeof(text_len));
+				if (offset + sizeof(id_len) > length) {
+					return false;
+				}
+				memcpy(&id_len, addr + offset, sizeof(id_len));
+				const char *p = addr + offset + sizeof(id_len);
+				if ((uint64_t)(p - addr) + id_len + stored_size > length) {
+					return false;
+				}
+				if ((flags & PACK_ZLIB) ? text_len > stored_size * PACK_MAX_RATIO : text_len != stored_size) {
+					return false;
+				}
+				id.assign(p, id_len);
+				p += id_len;
+
+				if (flags & PACK_ZLIB) {
+#ifdef HAVE_LIBZ
+					text.resize(text_len);
+					uLongf dest_len = text_len;
+					if (text_len > 0 && (uncompress((Bytef *)&text[0], &dest_len, (const Bytef *)p, stored_size) != Z_OK || dest_len != text_len)) {
+						return false;
+					}
+#endif
+				}
+				else {
+					text.assign(p, stored_size);
+				}
+				return true;
+			}
+
+		private:
+			static size_t index_entry_size() {
+				return 8 + 4 + 4;
+			}
+	};
+};
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef __PARAM_SEARCH_HPP__
+#define __PARAM_SEARCH_HPP__
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include "modality.hpp"
+#include "feature_matrix.hpp"
+#include "eval.hpp"
+
+namespace modality {
+	typedef struct {
+		int solver_type;
+		double C;
+		double accuracy;
+	} t_hyperparam;
+
+
+	/*
+	 * Grid search of liblinear solver type and C for each tag by k-fold cross
+	 * validation on feature matrices.
+	 * A job is one (tag, solver, fold); it trains the costs in ascending order
+	 * and warm-starts each C from the weights of the previous one when the
+	 * solver supports it. Jobs run on a pool of threads and their predictions
+	 * are scored with an evaluator per (tag, solver, C) in a fixed order.
+	 */
+	class param_search {
+		public:
+			std::vector<int> solvers;
+			// ascending
+			std::vector<double> costs;
+			unsigned int split_num;
+			int train_threads;
+			// cross validation accuracy of every (solver, C) for each tag
+			std::vector< t_hyperparam > scores[LABEL_NUM];
+
+		private:
+			typedef struct {
+				unsigned int tag;
+				unsigned int solver;
+				unsigned int fold;
+				// predicted labels of held-out rows for each cost
+				std::vector< std::vector<int> > predicted;
+			} t_job;
+
+			feature_matrix *matrices;
+			int nr_feature;
+			std::vector< t_job > jobs;
+			unsigned int next_job;
+			boost::mutex mtx;
+
+		public:
+			param_search() {
+				solvers.push_back(linear::L2R_LR);
+				solvers.push_back(linear::L2R_L2LOSS_SVC);
+				for (int i=-4 ; i<=4 ; i+=2) {
+					costs.push_back(std::pow(2.0, i));
+				}
+				split_num = 5;
+				train_threads = 1;
+				matrices = NULL;
+				nr_feature = 0;
+				next_job = 0;
+			}
+
+			static bool warm_startable(int solver_type) {
+				return solver_type == linear::L2R_LR || solver_type == linear::L2R_L2LOSS_SVC;
+			}
+
+			// liblinear's message for the first (solver, C) it rejects, NULL if it accepts all
+			const char *check_parameters(t_hyperparam *rejected) const {
+				linear::problem prob;
+				prob.l = 0;
+				prob.n = 0;
+				prob.y = NULL;
+				prob.x = NULL;
+				prob.bias = -1;
+				BOOST_FOREACH (int solver_type, solvers) {
+					BOOST_FOREACH (double C, costs) {
+						linear::parameter param = make_parameter(solver_type, C);
+						const char *error = linear::check_parameter(&prob, &param);
+						if (error != NULL) {
+							rejected->solver_type = solver_type;
+							rejected->C = C;
+							return error;
+						}
+					}
+				}
+				return NULL;
+			}
+
+			void fold_range(size_t rows, unsigned int fold, size_t *begin, size_t *end) {
+				size_t grp_size = rows / split_num;
+				*begin = fold * grp_size;
+				// last group = rest of rows
+				*end = (fold+1 == split_num) ? rows : (fold+1) * grp_size;
+			}
+
+			void run(feature_matrix *_matrices, int n, const std::vector<unsigned int> &tags, unsigned int n_threads, t_hyperparam *best) {
+				matrices = _matrices;
+				nr_feature = n;
+				jobs.clear();
+				BOOST_FOREACH (unsigned int tag, tags) {
+					for (unsigned int s=0 ; s<solvers.size() ; ++s) {
+						for (unsigned int f=0 ; f<split_num ; ++f) {
+							t_job job;
+							job.tag = tag;
+							job.solver = s;
+							job.fold = f;
+							jobs.push_back(job);
+						}
+					}
+				}
+
+				// the training log of every job would interleave
+				linear::set_print_string_function(&print_null);
+				next_job = 0;
+				if (n_threads > jobs.size()) {
+					n_threads = jobs.size();
+				}
+				boost::thread_group workers;
+				for (unsigned int i=0 ; i<n_threads ; ++i) {
+					workers.create_thread( boost::bind(&param_search::worker, this) );
+				}
+				workers.join_all();
+				linear::set_print_string_function(NULL);
+
+				// jobs are ordered by tag, solver and fold
+				std::vector< t_job >::iterator it_job = jobs.begin();
+				BOOST_FOREACH (unsigned int tag, tags) {
+					scores[tag].clear();
+					best[tag].accuracy = -1.0;
+					for (unsigned int s=0 ; s<solvers.size() ; ++s) {
+						std::vector< evaluator > evals(costs.size());
+						for (unsigned int f=0 ; f<split_num ; ++f, ++it_job) {
+							size_t begin, end;
+							fold_range(matrices[tag].rows(), f, &begin, &end);
+							for (unsigned int c=0 ; c<costs.size() ; ++c) {
+								for (size_t r=begin ; r<end ; ++r) {
+									std::string id = boost::lexical_cast<std::string>(r);
+									std::string gold = boost::lexical_cast<std::string>(matrices[tag].y[r]);
+									std::string sys = boost::lexical_cast<std::string>(it_job->predicted[c][r-begin]);
+									evals[c].add(id, gold, sys);
+								}
+							}
+						}
+						for (unsigned int c=0 ; c<costs.size() ; ++c) {
+							evals[c].eval();
+							t_hyperparam hp;
+							hp.solver_type = solvers[s];
+							hp.C = costs[c];
+							hp.accuracy = evals[c].accuracy();
+							scores[tag].push_back(hp);
+							// ties are broken by earlier solver and smaller C
+							if (hp.accuracy > best[tag].accuracy) {
+								best[tag] = hp;
+							}
+						}
+					}
+				}
+			}
+
+		private:
+			static void print_null(const char *) {
+			}
+
+			linear::parameter make_parameter(int solver_type, double C) const {
+				linear::parameter param;
+				param.solver_type = solver_type;
+				param.C = C;
+				param.eps = 0.01;
+				param.nr_weight = 0;
+				param.weight_label = NULL;
+				param.weight = NULL;
+				param.nr_thread = train_threads;
+				param.init_sol = NULL;
+				return param;
+			}
+
+			void worker() {
+				while (true) {
+					unsigned int i;
+					{
+						boost::mutex::scoped_lock lock(mtx);
+						if (next_job >= jobs.size()) {
+							return;
+						}
+						i = next_job++;
+					}
+					run_job(jobs[i]);
+				}
+			}
+
+			void run_job(t_job &job) {
+				feature_matrix &m = matrices[job.tag];
+
+				size_t begin, end;
+				fold_range(m.rows(), job.fold, &begin, &end);
+
+				std::vector< linear::feature_node* > x;
+				std::vector< int > y;
+				for (size_t r=0 ; r<m.rows() ; ++r) {
+					if (r < begin || end <= r) {
+						x.push_back(m.row(r));
+						y.push_back(m.y[r]);
+					}
+				}
+				linear::problem prob;
+				prob.l = y.size();
+				prob.n = nr_feature;
+				prob.y = y.empty() ? NULL : &y[0];
+				prob.x = x.empty() ? NULL : &x[0];
+				prob.bias = -1;
+
+				linear::parameter param = make_parameter(solvers[job.solver], costs[0]);
+
+				std::vector<double> w_prev;
+				job.predicted.resize(costs.size());
+				for (unsigned int c=0 ; c<costs.size() ; ++c) {
+					param.C = costs[c];
+					if (warm_startable(param.solver_type) && !w_prev.empty()) {
+						param.init_sol = &w_prev[0];
+					}
+					linear::model *model = linear::train(&prob, &param);
+
+					std::vector<int> &predicted = job.predicted[c];
+					for (size_t r=begin ; r<end ; ++r) {
+						predicted.push_back(linear::predict(model, m.row(r)));
+					}
+
+					size_t w_size = (size_t)nr_feature * (model->nr_class == 2 ? 1 : model->nr_class);
+					w_prev.assign(model->w, model->w + w_size);
+					linear::free_and_destroy_model(&model);
+				}
+			}
+	};
+};
+
+#endif
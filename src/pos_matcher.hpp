@@ -0,0 +1,160 @@
+#ifndef __POS_MATCHER_HPP__
+#define __POS_MATCHER_HPP__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+#include "sentence.hpp"
+
+namespace modality {
+	/*
+	 * POS sets of DETECT_BY_POS compiled into bit masks: bit p of masks[k]
+	 * of a POS is set when the k-th element of set p matches it, and a token
+	 * is a target when all the bits of some set are set along the tokens it
+	 * spans. A token is looked up once by its POS, then by its POS1 among
+	 * the few POS1 the sets have for that POS. A mask is words of 64 sets,
+	 * and the masks of the k-th elements are words [k*words, (k+1)*words).
+	 */
+	class pos_matcher {
+		private:
+			typedef struct {
+				std::string pos1;
+				std::vector< uint64_t > masks;
+			} t_pos1_masks;
+
+			typedef struct {
+				// elements whose POS1 is "*"
+				std::vector< uint64_t > any;
+				std::vector< t_pos1_masks > pos1s;
+			} t_pos_entry;
+
+			boost::unordered_map< std::string, t_pos_entry > table;
+			// ended[k]: sets shorter than k+1 tokens
+			std::vector< uint64_t > ended;
+			std::vector< uint64_t > sets;
+			unsigned int words;
+			unsigned int len;
+
+			// candidates of match() are on the stack up to this many words
+			static const unsigned int STACK_WORDS = 4;
+
+		public:
+			pos_matcher() {
+				words = 0;
+				len = 0;
+			}
+
+			// sets longer than max_len tokens never match, as in parse_pos_str()
+			bool compile(const std::vector< std::vector< std::vector<std::string> > > &pos_sets, int max_len) {
+				table.clear();
+				len = (max_len > 0) ? max_len : 0;
+				words = (pos_sets.size() + 63) / 64;
+				sets.assign(words, 0);
+				ended.assign(len * words, 0);
+
+				for (unsigned int p=0 ; p<pos_sets.size() ; ++p) {
+					const std::vector< std::vector<std::string> > &pos_set = pos_sets[p];
+					if (pos_set.size() > len) {
+						continue;
+					}
+					unsigned int w = p / 64;
+					uint64_t bit = (uint64_t)1 << (p % 64);
+					sets[w] |= bit;
+					for (unsigned int k=pos_set.size() ; k<len ; ++k) {
+						ended[k*words + w] |= bit;
+					}
+					for (unsigned int k=0 ; k<pos_set.size() ; ++k) {
+						const std::vector<std::string> &elem = pos_set[k];
+						t_pos_entry &entry = table[elem[0]];
+						if (entry.any.empty()) {
+							entry.any.assign(len * words, 0);
+						}
+						if (elem.size() < 2 || elem[1] == "*") {
+							entry.any[k*words + w] |= bit;
+							continue;
+						}
+						t_pos1_masks *pm = NULL;
+						for (unsigned int i=0 ; i<entry.pos1s.size() ; ++i) {
+							if (entry.pos1s[i].pos1 == elem[1]) {
+								pm = &entry.pos1s[i];
+							}
+						}
+						if (pm == NULL) {
+							entry.pos1s.push_back(t_pos1_masks());
+							pm = &entry.pos1s.back();
+							pm->pos1 = elem[1];
+							pm->masks.assign(len * words, 0);
+						}
+						pm->masks[k*words + w] |= bit;
+					}
+				}
+				return true;
+			}
+
+			bool match(nlp::token &tok, nlp::sentence &sent) const {
+				uint64_t stack_cand[STACK_WORDS];
+				std::vector< uint64_t > heap_cand;
+				uint64_t *cand = stack_cand;
+				if (words > STACK_WORDS) {
+					heap_cand.resize(words);
+					cand = &heap_cand[0];
+				}
+				bool left = false;
+				for (unsigned int w=0 ; w<words ; ++w) {
+					cand[w] = sets[w];
+					left |= (cand[w] != 0);
+				}
+
+				for (unsigned int k=0 ; k<len && left ; ++k) {
+					nlp::token *t = (k == 0) ? &tok : sent.get_token(tok.id+k);
+					if (t == NULL) {
+						for (unsigned int w=0 ; w<words ; ++w) {
+							if ((cand[w] & ended[k*words + w]) != 0) {
+								return true;
+							}
+						}
+						return false;
+					}
+					const uint64_t *any = NULL;
+					const uint64_t *pos1 = NULL;
+					lookup(*t, k, &any, &pos1);
+					left = false;
+					for (unsigned int w=0 ; w<words ; ++w) {
+						uint64_t m = ended[k*words + w];
+						if (any != NULL) {
+							m |= any[w];
+						}
+						if (pos1 != NULL) {
+							m |= pos1[w];
+						}
+						cand[w] &= m;
+						left |= (cand[w] != 0);
+					}
+				}
+				return left;
+			}
+
+		private:
+			// the masks of the k-th elements for the POS and the POS1 of tok;
+			// NULL when the sets have none. The POS is looked up by its string:
+			// pos_id and pos1_id are JUMAN's grammar ids, set for KNP input
+			// only, while the sets are written as strings for any dictionary
+			void lookup(const nlp::token &tok, unsigned int k, const uint64_t **any, const uint64_t **pos1) const {
+				boost::unordered_map< std::string, t_pos_entry >::const_iterator it = table.find(tok.pos);
+				if (it == table.end()) {
+					return;
+				}
+				*any = &it->second.any[k*words];
+				for (unsigned int i=0 ; i<it->second.pos1s.size() ; ++i) {
+					if (it->second.pos1s[i].pos1 == tok.pos1) {
+						*pos1 = &it->second.pos1s[i].masks[k*words];
+						return;
+					}
+				}
+			}
+	};
+};
+
+#endif
@@ -32,21 +32,33 @@ namespace nlp {
 				tids.push_back(boost::lexical_cast<int>(tid_str));
 			}
 
-			tag["source"] = l[2];
-			tag["tense"] = l[3];
-			tag["assumptional"] = l[4];
-			tag["type"] = l[5];
-			tag["authenticity"] = l[6];
-			tag["sentiment"] = l[7];
-			tag["focus"] = l[8];
+			for (unsigned int t=0 ; t<MOD_TAG_NUM ; ++t) {
+				set(t, l[2+t]);
+			}
 		}
 	}
 
-	void modality::str(std::string &str) {
+	void modality::str(std::string &str) const {
 		std::string tid_str;
 		join(tid_str, tids, ",");
 
-		str = tid_str + "\t" + tag["source"] + "\t" + tag["tense"] + "\t" + tag["assumptional"] + "\t" + tag["type"] + "\t" + tag["authenticity"] + "\t" + tag["sentiment"] + "\t" + tag["focus"];
+		str = tid_str;
+		for (unsigned int t=0 ; t<MOD_TAG_NUM ; ++t) {
+			str += "\t" + get(t);
+		}
+	}
+
+	const std::string &modality::tag_name(unsigned int t) {
+		static const std::string names[MOD_TAG_NUM] = {
+			"source",
+			"tense",
+			"assumptional",
+			"type",
+			"authenticity",
+			"sentiment",
+			"focus"
+		};
+		return names[t];
 	}
 };
 
@@ -2,11 +2,15 @@
 #define __SENTENCE_HPP__
 
 #include <iostream>
+#include <string>
 #include <vector>
+#include <cstdlib>
 #include <boost/unordered_map.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
 
 
 std::string join(std::vector<std::string>, std::string);
@@ -30,32 +34,133 @@ namespace nlp {
 			bool is_pred();
 	};
 	
+	// tags of an event, in the order of #EVENT lines; the same values as
+	// modality::SOURCE..SENTIMENT
+	enum {
+		MOD_SOURCE = 0,
+		MOD_TENSE,
+		MOD_ASSUMPTIONAL,
+		MOD_TYPE,
+		MOD_AUTHENTICITY,
+		MOD_SENTIMENT,
+		MOD_FOCUS,
+		MOD_TAG_NUM
+	};
+
+
+	/*
+	 * Labels of modality tags interned to ids for the life of the process.
+	 * The default labels are registered first so that a new modality is
+	 * made without a lookup; ids are shared by all threads.
+	 * Labels are kept in blocks that are never moved, so str() reads them
+	 * without the lock: a thread holding an id was given it after the label
+	 * had been stored.
+	 */
+	class mod_labels {
+		public:
+			static const unsigned int DEFAULT_SOURCE = 0;
+			static const unsigned int DEFAULT = 1;
+			static const unsigned int EMPTY = 2;
+
+			static unsigned int id(const std::string &label) {
+				mod_labels &t = table();
+				{
+					boost::shared_lock<boost::shared_mutex> lock(t.mtx);
+					boost::unordered_map< std::string, unsigned int >::const_iterator it = t.ids.find(label);
+					if (it != t.ids.end()) {
+						return it->second;
+					}
+				}
+				boost::unique_lock<boost::shared_mutex> lock(t.mtx);
+				return t.add(label);
+			}
+
+			static const std::string &str(unsigned int id) {
+				mod_labels &t = table();
+				return t.blocks[id / BLOCK_SIZE][id % BLOCK_SIZE];
+			}
+
+		private:
+			static const unsigned int BLOCK_SIZE = 256;
+			static const unsigned int MAX_BLOCKS = 4096;
+
+			// guards ids and the addition of labels
+			boost::shared_mutex mtx;
+			boost::unordered_map< std::string, unsigned int > ids;
+			std::string *blocks[MAX_BLOCKS];
+			unsigned int n_labels;
+
+			mod_labels() {
+				n_labels = 0;
+				for (unsigned int b=0 ; b<MAX_BLOCKS ; ++b) {
+					blocks[b] = NULL;
+				}
+				add("wr:筆者");
+				add("0");
+				add("");
+			}
+
+			~mod_labels() {
+				for (unsigned int b=0 ; b<MAX_BLOCKS ; ++b) {
+					delete[] blocks[b];
+				}
+			}
+
+			unsigned int add(const std::string &label) {
+				boost::unordered_map< std::string, unsigned int >::const_iterator it = ids.find(label);
+				if (it != ids.end()) {
+					return it->second;
+				}
+				unsigned int id = n_labels;
+				if (id / BLOCK_SIZE >= MAX_BLOCKS) {
+					std::cerr << "ERROR: too many modality labels" << std::endl;
+					exit(-1);
+				}
+				if (blocks[id / BLOCK_SIZE] == NULL) {
+					blocks[id / BLOCK_SIZE] = new std::string[BLOCK_SIZE];
+				}
+				blocks[id / BLOCK_SIZE][id % BLOCK_SIZE] = label;
+				ids[label] = id;
+				++n_labels;
+				return id;
+			}
+
+			static mod_labels &table() {
+				static mod_labels t;
+				return t;
+			}
+	};
+
+
 	class modality {
 		public:
 			std::vector<int> tids;
-			boost::unordered_map< std::string, std::string > tag;
-//			std::string source;
-//			std::string tense;
-//			std::string assumptional;
-//			std::string type;
-//			std::string authenticity;
-//			std::string sentiment;
-//			std::string focus;
+			// label id of each tag, by mod_labels
+			unsigned int tag[MOD_TAG_NUM];
 		public:
 			modality() {
-				tag["source"] = "wr:筆者";
-				tag["tense"] = "0";
-				tag["assumptional"] = "0";
-				tag["type"] = "0";
-				tag["authenticity"] = "0";
-				tag["sentiment"] = "0";
-				tag["focus"] = "0";
+				tag[MOD_SOURCE] = mod_labels::DEFAULT_SOURCE;
+				for (unsigned int t=MOD_TENSE ; t<MOD_TAG_NUM ; ++t) {
+					tag[t] = mod_labels::DEFAULT;
+				}
 			}
 			~modality() {
 			}
 		public:
+			const std::string &get(unsigned int t) const {
+				return mod_labels::str(tag[t]);
+			}
+			void set(unsigned int t, const std::string &label) {
+				tag[t] = mod_labels::id(label);
+			}
+			void clear() {
+				for (unsigned int t=0 ; t<MOD_TAG_NUM ; ++t) {
+					tag[t] = mod_labels::EMPTY;
+				}
+			}
+			static const std::string &tag_name(unsigned int);
 			void parse(const std::string &);
-			void str(std::string &);
+			void str(std::string &) const;
 			bool negation();
 			bool negation_strict();
 	};
@@ -105,6 +210,9 @@ namespace nlp {
 				read = "*";
 				pron = "*";
 				ne = "O";
+				// the ids are JUMAN's, given by KNP input only
+				pos_id = pos1_id = pos2_id = pos3_id = -1;
+				type_id = form_id = form2_id = -1;
 				has_mod = false;
 
 				judge_pos_juman = "詞";
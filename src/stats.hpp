@@ -0,0 +1,291 @@
+#ifndef __STATS_HPP__
+#define __STATS_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <stdint.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include "mem_stats.hpp"
+
+namespace modality {
+	// timers
+	enum {
+		ST_INPUT = 0,
+		ST_CABOCHA,
+		ST_SENT_PARSE,
+		ST_DETECT_TARGET,
+		ST_GEN_BASIC,
+		ST_GEN_FUNCTION,
+		ST_GEN_DST_CHUNKS,
+		ST_GEN_TTJ,
+		ST_GEN_MOD,
+		ST_GEN_FADIC,
+		ST_PACK,
+		ST_PREDICT,
+		ST_OUTPUT,
+		ST_LOAD,
+		ST_EXTRACT,
+		ST_TRAIN,
+		ST_TIMER_NUM
+	};
+
+	// counters
+	enum {
+		SC_SENTS = 0,
+		SC_TOKENS,
+		SC_TARGETS,
+		SC_INSTANCES,
+		SC_FEATURES,
+		SC_UNKNOWN_FEATURES,
+		SC_CDB_LOOKUPS,
+		SC_COUNTER_NUM
+	};
+
+	typedef struct {
+		uint64_t nsec[ST_TIMER_NUM];
+		uint64_t calls[ST_TIMER_NUM];
+		uint64_t counts[SC_COUNTER_NUM];
+	} t_stat_slots;
+
+
+	/*
+	 * Per-stage timers and counters, collected only when enabled (--stats).
+	 * Every thread adds to its own slots without locking; the slots outlive
+	 * their threads and are summed up when dumped as JSON, at exit and on
+	 * SIGUSR1.
+	 */
+	class stats {
+		public:
+			static bool enabled() {
+				return enabled_flag();
+			}
+
+			// called once by the main thread before any other thread starts
+			static void enable(const std::string &path) {
+				enabled_flag() = true;
+				dump_path() = path;
+				// constructed before the handler is registered, so that they
+				// are destroyed after it runs
+				registry();
+				registry_mtx();
+				atexit(&stats::dump_at_exit);
+
+				// SIGUSR1 is taken by the watcher only, so that dumping is not
+				// done in a signal handler
+				sigset_t set;
+				sigemptyset(&set);
+				sigaddset(&set, SIGUSR1);
+				pthread_sigmask(SIG_BLOCK, &set, NULL);
+				boost::thread watcher(&stats::watch);
+				watcher.detach();
+			}
+
+			static uint64_t now() {
+				if (!enabled()) {
+					return 0;
+				}
+				struct timespec ts;
+				clock_gettime(CLOCK_MONOTONIC, &ts);
+				return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+			}
+
+			static void add_time(unsigned int id, uint64_t since) {
+				if (!enabled()) {
+					return;
+				}
+				t_stat_slots *s = slots();
+				s->nsec[id] += now() - since;
+				s->calls[id]++;
+			}
+
+			static void count(unsigned int id, uint64_t n=1) {
+				if (!enabled()) {
+					return;
+				}
+				slots()->counts[id] += n;
+			}
+
+			static void dump(std::ostream &os) {
+				t_stat_slots sum;
+				size_t n_threads;
+				{
+					boost::mutex::scoped_lock lock(registry_mtx());
+					std::vector< t_stat_slots* > &reg = registry();
+					n_threads = reg.size();
+					for (unsigned int i=0 ; i<ST_TIMER_NUM ; ++i) {
+						sum.nsec[i] = 0;
+						sum.calls[i] = 0;
+						for (size_t t=0 ; t<reg.size() ; ++t) {
+							sum.nsec[i] += reg[t]->nsec[i];
+							sum.calls[i] += reg[t]->calls[i];
+						}
+					}
+					for (unsigned int i=0 ; i<SC_COUNTER_NUM ; ++i) {
+						sum.counts[i] = 0;
+						for (size_t t=0 ; t<reg.size() ; ++t) {
+							sum.counts[i] += reg[t]->counts[i];
+						}
+					}
+				}
+
+				std::streamsize prec = os.precision();
+				os << "{\n";
+				os << "  \"threads\": " << n_threads << ",\n";
+				os << "  \"timers\": {\n";
+				for (unsigned int i=0 ; i<ST_TIMER_NUM ; ++i) {
+					os << "    \"" << timer_names()[i] << "\": {\"calls\": " << sum.calls[i] << ", \"sec\": " << std::fixed << std::setprecision(6) << sum.nsec[i] / 1e9 << "}";
+					os << (i+1 < ST_TIMER_NUM ? ",\n" : "\n");
+				}
+				os << "  },\n";
+				os << "  \"counters\": {\n";
+				for (unsigned int i=0 ; i<SC_COUNTER_NUM ; ++i) {
+					os << "    \"" << counter_name(i) << "\": " << sum.counts[i];
+					os << (i+1 < SC_COUNTER_NUM ? ",\n" : "\n");
+				}
+				os << "  },\n";
+				if (mem_stats::enabled()) {
+					mem_stats::dump(os, timer_names(), ST_TIMER_NUM, sum.counts[SC_SENTS]);
+				}
+				double per_inst = sum.counts[SC_INSTANCES] ? (double)sum.counts[SC_FEATURES] / sum.counts[SC_INSTANCES] : 0.0;
+				double unk_rate = sum.counts[SC_FEATURES] ? (double)sum.counts[SC_UNKNOWN_FEATURES] / sum.counts[SC_FEATURES] : 0.0;
+				os << "  \"features_per_instance\": " << per_inst << ",\n";
+				os << "  \"unknown_feature_rate\": " << unk_rate << "\n";
+				os << "}" << std::endl;
+				os.unsetf(std::ios::fixed);
+				os.precision(prec);
+			}
+
+			static void dump() {
+				const std::string &path = dump_path();
+				if (path == "-") {
+					dump(std::cerr);
+					return;
+				}
+				std::ofstream ofs(path.c_str());
+				if (!ofs) {
+					std::cerr << "ERROR: cannot write " << path << std::endl;
+					return;
+				}
+				dump(ofs);
+			}
+
+		private:
+			static bool &enabled_flag() {
+				static bool flag = false;
+				return flag;
+			}
+
+			static std::string &dump_path() {
+				static std::string path;
+				return path;
+			}
+
+			static boost::mutex &registry_mtx() {
+				static boost::mutex mtx;
+				return mtx;
+			}
+
+			static std::vector< t_stat_slots* > &registry() {
+				static std::vector< t_stat_slots* > reg;
+				return reg;
+			}
+
+			// registered slots are owned by the registry
+			static void keep_slots(t_stat_slots *) {
+			}
+
+			static t_stat_slots *slots() {
+				static boost::thread_specific_ptr< t_stat_slots > tls(&stats::keep_slots);
+				t_stat_slots *s = tls.get();
+				if (s == NULL) {
+					s = new t_stat_slots();
+					tls.reset(s);
+					boost::mutex::scoped_lock lock(registry_mtx());
+					registry().push_back(s);
+				}
+				return s;
+			}
+
+			static void dump_at_exit() {
+				dump();
+			}
+
+			static void watch() {
+				sigset_t set;
+				sigemptyset(&set);
+				sigaddset(&set, SIGUSR1);
+				while (true) {
+					int sig;
+					if (sigwait(&set, &sig) == 0) {
+						dump();
+					}
+				}
+			}
+
+			static const char **timer_names() {
+				static const char *names[ST_TIMER_NUM] = {
+					"input",
+					"cabocha",
+					"sentence_parse",
+					"detect_target",
+					"gen_feature_basic",
+					"gen_feature_function",
+					"gen_feature_dst_chunks",
+					"gen_feature_ttj",
+					"gen_feature_mod",
+					"gen_feature_fadic",
+					"pack_features",
+					"predict",
+					"output",
+					"load",
+					"extract_features",
+					"train"
+				};
+				return names;
+			}
+
+			static const char *counter_name(unsigned int id) {
+				static const char *names[SC_COUNTER_NUM] = {
+					"sents",
+					"tokens",
+					"targets",
+					"instances",
+					"features",
+					"unknown_features",
+					"cdb_lookups"
+				};
+				return names[id];
+			}
+	};
+
+
+	// time of the enclosing scope, which is also the stage of its allocations
+	class stat_timer {
+		private:
+			unsigned int id;
+			uint64_t start;
+			int prev_stage;
+
+		public:
+			stat_timer(unsigned int _id) {
+				id = _id;
+				start = stats::now();
+				prev_stage = mem_stats::enter(id);
+			}
+
+			~stat_timer() {
+				mem_stats::leave(prev_stage);
+				stats::add_time(id, start);
+			}
+	};
+};
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef __WRITER_HPP__
+#define __WRITER_HPP__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include <boost/unordered_map.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/foreach.hpp>
+#include "sentence.hpp"
+#include "modality.hpp"
+
+namespace modality {
+	enum {
+		OUT_TEXT = 0,
+		OUT_JSONL = 1,
+		OUT_BINARY = 2
+	};
+
+	enum {
+		RESULT_SCORES = 1
+	};
+
+	/*
+	 * Writes analyzed sentences straight to a stream, one at a time.
+	 *
+	 * text   - #EVENT lines followed by the input, as analyzeToString()
+	 * jsonl  - a JSON object per line:
+	 *          {"sent": n, "events": [{"tids": [...], "source": "...", ...,
+	 *          "scores": {"tense": {"label": value, ...}, ...}}, ...]}
+	 * binary - layout (native byte order):
+	 *   "ZRB1", uint32 flags, uint32 tags, tags times (uint32 length, name),
+	 *   uint32 labels, labels times (uint32 length, label),
+	 *   then records of (uint32 payload length, payload), the payload being
+	 *   'L', label
+	 *     a label not in the header, which takes the next label id
+	 *   'S', uint32 sentence, uint32 events, events times (uint32 tids,
+	 *   tids times uint32 token id, tags times uint32 label id)
+	 *     where each event is followed, when flags has RESULT_SCORES, by
+	 *     uint8 predictions, predictions times (uint8 tag, uint8 values,
+	 *     values times (uint32 label id, float32 decision value))
+	 *
+	 * Scores are the decision values of liblinear for the classes of the model
+	 * of each predicted tag; a two-class model has one value, of its first
+	 * class.
+	 */
+	class result_writer {
+		private:
+			parser *mod_parser;
+			std::ostream *os;
+			int format;
+			bool scores;
+			// flush after every sentence, for text, which is read line by
+			// line, and for a terminal; a pipe or a file of jsonl or binary
+			// records is left to the buffer of the stream
+			bool flush_each;
+			uint32_t sent_cnt;
+			// predictions of the sentence being written, when scores is set
+			std::vector< t_decision > decisions;
+			std::vector< std::string > labels;
+			boost::unordered_map< std::string, uint32_t > label_ids;
+			// label of each class of the model of each tag
+			std::vector< std::string > class_labels[LABEL_NUM];
+			std::vector< const nlp::token* > events;
+
+		public:
+			result_writer(parser *_mod_parser, std::ostream *_os, int _format, bool _scores) {
+				mod_parser = _mod_parser;
+				os = _os;
+				format = _format;
+				scores = _scores && format != OUT_TEXT;
+				flush_each = format == OUT_TEXT || (os == &std::cout && isatty(STDOUT_FILENO));
+				sent_cnt = 0;
+
+				nlp::modality defaults;
+				for (unsigned int t=0 ; t<nlp::MOD_TAG_NUM ; ++t) {
+					label_id(defaults.get(t));
+				}
+				BOOST_FOREACH (unsigned int i, mod_parser->analyze_tags) {
+					const linear::model *m = mod_parser->models[i];
+					for (int k=0 ; k<m->nr_class ; ++k) {
+						std::string label;
+						if (!mod_parser->i2l.get(m->label[k], &label)) {
+							label = boost::lexical_cast< std::string >(m->label[k]);
+						}
+						class_labels[i].push_back(label);
+						label_id(label);
+					}
+				}
+
+				if (scores) {
+					mod_parser->decisions = &decisions;
+				}
+				if (format == OUT_BINARY) {
+					write_header();
+				}
+			}
+
+			~result_writer() {
+				os->flush();
+				if (scores) {
+					mod_parser->decisions = NULL;
+				}
+			}
+
+			static bool parse_format(const std::string &name, int *_format) {
+				if (name == "text") {
+					*_format = OUT_TEXT;
+				}
+				else if (name == "jsonl") {
+					*_format = OUT_JSONL;
+				}
+				else if (name == "binary") {
+					*_format = OUT_BINARY;
+				}
+				else {
+					return false;
+				}
+				return true;
+			}
+
+			void write(const nlp::sentence &sent) {
+				events.clear();
+				BOOST_FOREACH (const nlp::chunk &chk, sent.chunks) {
+					BOOST_FOREACH (const nlp::token &tok, chk.tokens) {
+						if (tok.has_mod) {
+							events.push_back(&tok);
+						}
+					}
+				}
+
+				switch (format) {
+					case OUT_TEXT:
+						write_text(sent);
+						break;
+					case OUT_JSONL:
+						write_jsonl();
+						break;
+					case OUT_BINARY:
+						write_binary();
+						break;
+				}
+				if (flush_each) {
+					os->flush();
+				}
+				decisions.clear();
+				sent_cnt++;
+			}
+
+			// the sentence was not analyzed; it keeps its number in the output
+			void skip() {
+				decisions.clear();
+				sent_cnt++;
+			}
+
+		private:
+			static const std::string &tag_value(const nlp::token &tok, unsigned int t) {
+				return tok.mod.get(t);
+			}
+
+			uint32_t label_id(const std::string &label) {
+				boost::unordered_map< std::string, uint32_t >::const_iterator it = label_ids.find(label);
+				if (it != label_ids.end()) {
+					return it->second;
+				}
+				uint32_t id = labels.size();
+				labels.push_back(label);
+				label_ids[label] = id;
+				return id;
+			}
+
+			void write_text(const nlp::sentence &sent) {
+				for (size_t e=0 ; e<events.size() ; ++e) {
+					const nlp::token &tok = *events[e];
+					*os << "#EVENT" << e << '\t';
+					for (size_t i=0 ; i<tok.mod.tids.size() ; ++i) {
+						if (i > 0) {
+							*os << ',';
+						}
+						*os << tok.mod.tids[i];
+					}
+					for (unsigned int t=0 ; t<nlp::MOD_TAG_NUM ; ++t) {
+						*os << '\t' << tag_value(tok, t);
+					}
+					*os << '\n';
+				}
+				*os << sent.input_orig << '\n';
+			}
+
+			void write_json_string(const std::string &str) {
+				static const char hex[] = "0123456789abcdef";
+				*os << '"';
+				BOOST_FOREACH (char c, str) {
+					switch (c) {
+						case '"':
+							*os << "\\\"";
+							break;
+						case '\\':
+							*os << "\\\\";
+							break;
+						case '\n':
+							*os << "\\n";
+							break;
+						case '\t':
+							*os << "\\t";
+							break;
+						default:
+							if ((unsigned char)c < 0x20) {
+								*os << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+							}
+							else {
+								*os << c;
+							}
+					}
+				}
+				*os << '"';
+			}
+
+			void write_jsonl() {
+				*os << "{\"sent\": " << sent_cnt << ", \"events\": [";
+				for (size_t e=0 ; e<events.size() ; ++e) {
+					const nlp::token &tok = *events[e];
+					*os << (e > 0 ? ", " : "") << "{\"tids\": [";
+					for (size_t i=0 ; i<tok.mod.tids.size() ; ++i) {
+						*os << (i > 0 ? ", " : "") << tok.mod.tids[i];
+					}
+					*os << ']';
+					for (unsigned int t=0 ; t<nlp::MOD_TAG_NUM ; ++t) {
+						*os << ", \"" << nlp::modality::tag_name(t) << "\": ";
+						write_json_string(tag_value(tok, t));
+					}
+					if (scores) {
+						*os << ", \"scores\": {";
+						bool first = true;
+						BOOST_FOREACH (const t_decision &d, decisions) {
+							if (d.tok_id != (unsigned int)tok.id) {
+								continue;
+							}
+							*os << (first ? "" : ", ") << '"' << nlp::modality::tag_name(d.tag) << "\": {";
+							for (size_t k=0 ; k<d.values.size() ; ++k) {
+								*os << (k > 0 ? ", " : "");
+								write_json_string(class_labels[d.tag][k]);
+								*os << ": " << d.values[k];
+							}
+							*os << '}';
+							first = false;
+						}
+						*os << '}';
+					}
+					*os << '}';
+				}
+				*os << "]}\n";
+			}
+
+			void put_u8(uint8_t v) {
+				os->put((char)v);
+			}
+
+			void put_u32(uint32_t v) {
+				os->write((const char *)&v, sizeof(v));
+			}
+
+			void put_str(const std::string &str) {
+				put_u32(str.size());
+				os->write(str.data(), str.size());
+			}
+
+			void write_header() {
+				os->write("ZRB1", 4);
+				put_u32(scores ? RESULT_SCORES : 0);
+				put_u32(nlp::MOD_TAG_NUM);
+				for (unsigned int t=0 ; t<nlp::MOD_TAG_NUM ; ++t) {
+					put_str(nlp::modality::tag_name(t));
+				}
+				put_u32(labels.size());
+				BOOST_FOREACH (const std::string &label, labels) {
+					put_str(label);
+				}
+			}
+
+			// the size of a record is counted before it is written
+			void write_binary() {
+				uint32_t size = 1 + 4 + 4;
+				BOOST_FOREACH (const nlp::token *tok, events) {
+					for (unsigned int t=0 ; t<nlp::MOD_TAG_NUM ; ++t) {
+						const std::string &label = tag_value(*tok, t);
+						if (label_ids.find(label) == label_ids.end()) {
+							label_id(label);
+							put_u32(1 + label.size());
+							put_u8('L');
+							os->write(label.data(), label.size());
+						}
+					}
+					size += 4 + 4 * tok->mod.tids.size() + 4 * nlp::MOD_TAG_NUM;
+					if (scores) {
+						size += 1;
+						BOOST_FOREACH (const t_decision &d, decisions) {
+							if (d.tok_id == (unsigned int)tok->id) {
+								size += 1 + 1 + (4 + 4) * d.values.size();
+							}
+						}
+					}
+				}
+
+				put_u32(size);
+				put_u8('S');
+				put_u32(sent_cnt);
+				put_u32(events.size());
+				BOOST_FOREACH (const nlp::token *tok, events) {
+					put_u32(tok->mod.tids.size());
+					BOOST_FOREACH (int tid, tok->mod.tids) {
+						put_u32(tid);
+					}
+					for (unsigned int t=0 ; t<nlp::MOD_TAG_NUM ; ++t) {
+						put_u32(label_ids[tag_value(*tok, t)]);
+					}
+					if (!scores) {
+						continue;
+					}
+					uint8_t n_decisions = 0;
+					BOOST_FOREACH (const t_decision &d, decisions) {
+						if (d.tok_id == (unsigned int)tok->id) {
+							n_decisions++;
+						}
+					}
+					put_u8(n_decisions);
+					BOOST_FOREACH (const t_decision &d, decisions) {
+						if (d.tok_id != (unsigned int)tok->id) {
+							continue;
+						}
+						put_u8(d.tag);
+						put_u8(d.values.size());
+						for (size_t k=0 ; k<d.values.size() ; ++k) {
+							float value = d.values[k];
+							put_u32(label_ids[class_labels[d.tag][k]]);
+							os->write((const char *)&value, sizeof(value));
+						}
+					}
+				}
+			}
+	};
+};
+
+#endif
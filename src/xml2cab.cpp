@@ -8,14 +8,17 @@
 #include <boost/foreach.hpp>
 #include "sentence.hpp"
 #include "modality.hpp"
+#include "packed_corpus.hpp"
 
 int main(int argc, char *argv[]) {
 
 	boost::program_options::options_description opt("Usage", 200);
 	opt.add_options()
-		("file,f", boost::program_options::value<std::string>(), "input xml file (required)")
+		("file,f", boost::program_options::value< std::vector<std::string> >()->multitoken(), "input xml file (required); with --pack, .depmod files are also accepted")
 		("outdir,o", boost::program_options::value<std::string>(), "output directory (optional): default same as input xml file")
 		("enable-wl", "enabled parsing webLine tag")
+		("pack", boost::program_options::value<std::string>(), "write the sentences of all input files into a packed corpus instead of .depmod files")
+		("compress", "compress the sentences of the packed corpus with zlib")
 		("help,h", "Show help messages")
 		("version,v", "Show version informaion");
 
@@ -33,53 +36,106 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
-	std::string xml;
+	std::vector<std::string> xmls;
 	if (argmap.count("file")) {
-		xml = argmap["file"].as<std::string>();
+		xmls = argmap["file"].as< std::vector<std::string> >();
 	}
 	else {
 		std::cerr << "error: input xml file is required" << std::endl;
 		exit(-1);
 	}
-	std::cerr << "input: " << xml << std::endl;
-	boost::filesystem::path xml_path(xml);
 
-	std::string outdir;
-	if (argmap.count("outdir")) {
-		outdir = argmap["outdir"].as<std::string>();
+	modality::packed_corpus_writer pack;
+	if (argmap.count("pack")) {
+		std::string pack_path = argmap["pack"].as<std::string>();
+		if (!pack.open(pack_path, argmap.count("compress") > 0)) {
+			std::cerr << "error: cannot write " << pack_path << std::endl;
+			exit(-1);
+		}
+		std::cerr << "pack: " << pack_path << std::endl;
 	}
-	else {
-		outdir = xml_path.parent_path().string();
+	else if (argmap.count("compress")) {
+		std::cerr << "error: --compress needs --pack" << std::endl;
+		exit(-1);
 	}
-	std::cerr << "outdir: " << outdir << std::endl;
-	boost::filesystem::path outdir_path(outdir);
 
-	modality::parser mod_parser;
+	// the dictionaries are opened only when a xml file is converted
+	modality::parser *mod_parser = NULL;
 
-	std::vector< std::vector< modality::t_token > > sents;
-	if (argmap.count("enable-wl")) {
-		sents = mod_parser.parse_OC(xml_path.string());
-	}
-	else {
-		sents = mod_parser.parse_OW_PB_PN(xml_path.string());
+	BOOST_FOREACH ( const std::string &xml, xmls ) {
+		std::cerr << "input: " << xml << std::endl;
+		boost::filesystem::path xml_path(xml);
+		boost::filesystem::path stem(xml_path.stem());
+
+		// already converted sentences are packed as they are
+		if (argmap.count("pack") && xml_path.extension() == ".depmod") {
+			std::ifstream ifs(xml.c_str());
+			std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+			if (!ifs || !pack.add(stem.string(), text)) {
+				std::cerr << "error: cannot pack " << xml << std::endl;
+				exit(-1);
+			}
+			continue;
+		}
+
+		std::string outdir;
+		if (argmap.count("outdir")) {
+			outdir = argmap["outdir"].as<std::string>();
+		}
+		else {
+			outdir = xml_path.parent_path().string();
+		}
+		boost::filesystem::path outdir_path(outdir);
+		if (!argmap.count("pack")) {
+			std::cerr << "outdir: " << outdir << std::endl;
+		}
+
+		if (mod_parser == NULL) {
+			mod_parser = new modality::parser;
+		}
+		std::vector< std::vector< modality::t_token > > sents;
+		if (argmap.count("enable-wl")) {
+			sents = mod_parser->parse_OC(xml_path.string());
+		}
+		else {
+			sents = mod_parser->parse_OW_PB_PN(xml_path.string());
+		}
+
+		int cnt = 0;
+		BOOST_FOREACH ( std::vector< modality::t_token > sent, sents ) {
+			nlp::sentence *mod_ipa_sent = new nlp::sentence;
+			mod_parser->make_tagged_ipasents(sent, modality::IN_DEP_CAB, *mod_ipa_sent);
+
+			std::stringstream ss;
+			ss << stem.string() << "_" << std::setw(3) << std::setfill('0') << cnt;
+			std::string cabocha_str;
+			mod_ipa_sent->cabocha(cabocha_str);
+			if (argmap.count("pack")) {
+				if (!pack.add(ss.str(), cabocha_str + "\n")) {
+					std::cerr << "error: cannot pack " << ss.str() << std::endl;
+					exit(-1);
+				}
+			}
+			else {
+				std::string out = (outdir_path / ss.str()).string() + ".depmod";
+				std::cerr << "output: " << out << std::endl;
+				std::ofstream os(out.c_str());
+				os << cabocha_str << std::endl;
+				os.close();
+			}
+			cnt++;
+
+			delete mod_ipa_sent;
+		}
 	}
+	delete mod_parser;
 
-	int cnt = 0;
-	BOOST_FOREACH ( std::vector< modality::t_token > sent, sents ) {
-		nlp::sentence *mod_ipa_sent = new nlp::sentence;
-		mod_parser.make_tagged_ipasents(sent, modality::IN_DEP_CAB, *mod_ipa_sent);
-
-		std::stringstream ss;
-		ss << (outdir_path / xml_path.stem()).string() << "_" << std::setw(3) << std::setfill('0') << cnt << ".depmod";
-		std::cerr << "output: " << ss.str() << std::endl;
-		std::ofstream os(ss.str().c_str());
-		std::string cabocha_str;
-		mod_ipa_sent->cabocha(cabocha_str);
-		os << cabocha_str << std::endl;
-		os.close();
-		cnt++;
-
-		delete mod_ipa_sent;
+	if (argmap.count("pack")) {
+		std::cerr << "packed: " << pack.size() << " sentences" << std::endl;
+		if (!pack.close()) {
+			std::cerr << "error: cannot write " << argmap["pack"].as<std::string>() << std::endl;
+			exit(-1);
+		}
 	}
 
 	return true;
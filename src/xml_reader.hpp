@@ -0,0 +1,244 @@
+#ifndef __XML_READER_HPP__
+#define __XML_READER_HPP__
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+
+namespace modality {
+	// attributes in document order
+	typedef std::vector< std::pair< std::string, std::string > > t_xml_attrs;
+
+
+	class xml_handler {
+		public:
+			virtual ~xml_handler() {
+			}
+			virtual void start_element(const std::string &, const t_xml_attrs &) = 0;
+			virtual void end_element(const std::string &) = 0;
+	};
+
+
+	/*
+	 * SAX-style reader for the well-formed XML of the BCCWJ corpus.
+	 * Start and end tags are reported to a handler in document order without
+	 * building a tree; text, comments, CDATA, processing instructions and
+	 * doctype declarations are skipped.
+	 */
+	class xml_reader {
+		private:
+			std::string buf;
+			size_t pos;
+
+		public:
+			bool parse_file(const std::string &path, xml_handler &handler) {
+				std::ifstream ifs(path.c_str(), std::ios_base::binary);
+				if (!ifs) {
+					std::cerr << "ERROR: cannot open " << path << std::endl;
+					return false;
+				}
+				buf.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+				bool ok = parse(handler);
+				if (!ok) {
+					std::cerr << "ERROR: malformed xml at byte " << pos << " in " << path << std::endl;
+				}
+				buf.clear();
+				return ok;
+			}
+
+			bool parse_string(const std::string &str, xml_handler &handler) {
+				buf = str;
+				bool ok = parse(handler);
+				buf.clear();
+				return ok;
+			}
+
+		private:
+			bool parse(xml_handler &handler) {
+				std::string name;
+				t_xml_attrs attrs;
+				pos = 0;
+				while (true) {
+					pos = buf.find('<', pos);
+					if (pos == std::string::npos) {
+						return true;
+					}
+					if (buf.compare(pos, 4, "<!--") == 0) {
+						if (!skip_to("-->")) {
+							return false;
+						}
+					}
+					else if (buf.compare(pos, 9, "<![CDATA[") == 0) {
+						if (!skip_to("]]>")) {
+							return false;
+						}
+					}
+					else if (buf.compare(pos, 2, "<?") == 0) {
+						if (!skip_to("?>")) {
+							return false;
+						}
+					}
+					else if (buf.compare(pos, 2, "<!") == 0) {
+						if (!skip_to(">")) {
+							return false;
+						}
+					}
+					else if (buf.compare(pos, 2, "</") == 0) {
+						pos += 2;
+						read_name(name);
+						skip_space();
+						if (name.empty() || pos >= buf.size() || buf[pos] != '>') {
+							return false;
+						}
+						++pos;
+						handler.end_element(name);
+					}
+					else {
+						++pos;
+						read_name(name);
+						if (name.empty()) {
+							return false;
+						}
+						attrs.clear();
+						bool empty_elem = false;
+						while (true) {
+							skip_space();
+							if (pos >= buf.size()) {
+								return false;
+							}
+							if (buf[pos] == '>') {
+								++pos;
+								break;
+							}
+							if (buf.compare(pos, 2, "/>") == 0) {
+								pos += 2;
+								empty_elem = true;
+								break;
+							}
+							std::pair< std::string, std::string > attr;
+							read_name(attr.first);
+							skip_space();
+							if (attr.first.empty() || pos >= buf.size() || buf[pos] != '=') {
+								return false;
+							}
+							++pos;
+							skip_space();
+							if (pos >= buf.size() || (buf[pos] != '"' && buf[pos] != '\'')) {
+								return false;
+							}
+							size_t end = buf.find(buf[pos], pos+1);
+							if (end == std::string::npos) {
+								return false;
+							}
+							decode(buf, pos+1, end, attr.second);
+							pos = end + 1;
+							attrs.push_back(attr);
+						}
+						handler.start_element(name, attrs);
+						if (empty_elem) {
+							handler.end_element(name);
+						}
+					}
+				}
+			}
+
+			bool skip_to(const char *term) {
+				size_t end = buf.find(term, pos);
+				if (end == std::string::npos) {
+					return false;
+				}
+				pos = end + std::string(term).size();
+				return true;
+			}
+
+			void skip_space() {
+				while (pos < buf.size() && (buf[pos] == ' ' || buf[pos] == '\t' || buf[pos] == '\n' || buf[pos] == '\r')) {
+					++pos;
+				}
+			}
+
+			void read_name(std::string &name) {
+				size_t begin = pos;
+				while (pos < buf.size()) {
+					char c = buf[pos];
+					if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '>' || c == '/' || c == '=') {
+						break;
+					}
+					++pos;
+				}
+				name.assign(buf, begin, pos-begin);
+			}
+
+			static void append_utf8(unsigned long c, std::string &out) {
+				if (c < 0x80) {
+					out += (char)c;
+				}
+				else if (c < 0x800) {
+					out += (char)(0xC0 | (c >> 6));
+					out += (char)(0x80 | (c & 0x3F));
+				}
+				else if (c < 0x10000) {
+					out += (char)(0xE0 | (c >> 12));
+					out += (char)(0x80 | ((c >> 6) & 0x3F));
+					out += (char)(0x80 | (c & 0x3F));
+				}
+				else {
+					out += (char)(0xF0 | (c >> 18));
+					out += (char)(0x80 | ((c >> 12) & 0x3F));
+					out += (char)(0x80 | ((c >> 6) & 0x3F));
+					out += (char)(0x80 | (c & 0x3F));
+				}
+			}
+
+			// str[begin, end) with entity and character references resolved
+			static void decode(const std::string &str, size_t begin, size_t end_pos, std::string &out) {
+				if (std::find(str.begin() + begin, str.begin() + end_pos, '&') == str.begin() + end_pos) {
+					out.assign(str, begin, end_pos-begin);
+					return;
+				}
+				out.clear();
+				for (size_t i=begin ; i<end_pos ; ++i) {
+					if (str[i] != '&') {
+						out += str[i];
+						continue;
+					}
+					size_t end = std::find(str.begin() + i, str.begin() + end_pos, ';') - str.begin();
+					if (end == end_pos) {
+						out += str[i];
+						continue;
+					}
+					std::string ref = str.substr(i+1, end-i-1);
+					if (ref == "lt") {
+						out += '<';
+					}
+					else if (ref == "gt") {
+						out += '>';
+					}
+					else if (ref == "amp") {
+						out += '&';
+					}
+					else if (ref == "quot") {
+						out += '"';
+					}
+					else if (ref == "apos") {
+						out += '\'';
+					}
+					else if (ref.size() > 1 && ref[0] == '#') {
+						unsigned long c = (ref[1] == 'x' || ref[1] == 'X') ? strtoul(ref.c_str()+2, NULL, 16) : strtoul(ref.c_str()+1, NULL, 10);
+						append_utf8(c, out);
+					}
+					else {
+						// unknown entities are kept as they are
+						out += str.substr(i, end-i+1);
+					}
+					i = end;
+				}
+			}
+	};
+};
+
+#endif
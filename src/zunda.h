@@ -0,0 +1,85 @@
+#ifndef __ZUNDA_H__
+#define __ZUNDA_H__
+
+/*
+ * libzunda: extended modality analysis of sentences given as morphemes and
+ * chunks, as MeCab/CaboCha have them in memory.
+ *
+ * A handle is made once from a model directory and a dictionary directory
+ * and may be shared by any number of threads; zunda_analyze() is reentrant.
+ * Label strings in the results are owned by the handle and valid until it
+ * is destroyed.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* POS tag sets of the morphemes */
+enum {
+	ZUNDA_POS_IPA = 0,
+	ZUNDA_POS_JUMAN = 1
+};
+
+/* tags of an event, in the order of #EVENT lines */
+enum {
+	ZUNDA_SOURCE = 0,
+	ZUNDA_TENSE,
+	ZUNDA_ASSUMPTIONAL,
+	ZUNDA_TYPE,
+	ZUNDA_AUTHENTICITY,
+	ZUNDA_SENTIMENT,
+	ZUNDA_FOCUS,
+	ZUNDA_TAG_NUM
+};
+
+/*
+ * A morpheme, with the fields of a MeCab feature; NULL is taken as "*".
+ * For ZUNDA_POS_JUMAN the fields are in the order of JumanDic features,
+ * that is pos[0..3] are the four columns before the lemma.
+ */
+typedef struct {
+	const char *surface;
+	const char *lemma;
+	const char *pos[4];
+	const char *conj_type;
+	const char *conj_form;
+	const char *reading;
+	const char *pron;
+	/* index of the chunk of the morpheme; chunks are in order from 0 */
+	int chunk;
+} zunda_morph_t;
+
+/* an event: the index of its morpheme and its tags */
+typedef struct {
+	int token;
+	const char *tags[ZUNDA_TAG_NUM];
+} zunda_event_t;
+
+typedef struct zunda_t zunda_t;
+
+/*
+ * NULL model_dir or dic_dir is the installed one; returns NULL if a model
+ * or a dictionary cannot be loaded
+ */
+zunda_t *zunda_new(const char *model_dir, const char *dic_dir, int pos_tag);
+void zunda_destroy(zunda_t *z);
+
+/*
+ * Analyzes a sentence of n_morphs morphemes and n_chunks chunks, heads[i]
+ * being the index of the chunk chunk i depends on (-1 for the root).
+ * At most max_events events are written in the order of their morphemes;
+ * returns the number of events of the sentence, which is never larger than
+ * n_morphs, or -1 for an invalid sentence.
+ */
+int zunda_analyze(zunda_t *z, const zunda_morph_t *morphs, size_t n_morphs, const int *heads, size_t n_chunks, zunda_event_t *events, size_t max_events);
+
+const char *zunda_tag_name(int tag);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
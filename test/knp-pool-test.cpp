@@ -0,0 +1,107 @@
+/*
+ * knp_pool against test/knp-stub.sh:
+ *   knp-pool-test <path of knp-stub.sh>
+ * Exits with 0 when every check passes.
+ */
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "knp_pool.hpp"
+
+
+int failures = 0;
+
+void check(bool ok, const std::string &what) {
+	std::cout << (ok ? "ok: " : "FAIL: ") << what << std::endl;
+	if (!ok) {
+		++failures;
+	}
+}
+
+
+// the stub echoes the sentence as the 4th of 5 lines
+bool echoed(const std::vector<std::string> &lines, const std::string &text) {
+	return lines.size() == 5 && lines[3] == text && lines[4] == "EOS";
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " knp-stub.sh" << std::endl;
+		return 2;
+	}
+	std::string stub = argv[1];
+
+	std::vector<std::string> texts;
+	for (int i=0 ; i<100 ; ++i) {
+		std::stringstream ss;
+		ss << "sentence " << i;
+		texts.push_back(ss.str());
+	}
+	std::vector< std::vector<std::string> > results;
+	{
+		modality::knp_pool pool(stub, 4);
+		bool ok = pool.parse_all(texts, results) && results.size() == texts.size();
+		for (size_t i=0 ; ok && i<texts.size() ; ++i) {
+			ok = echoed(results[i], texts[i]);
+		}
+		check(ok, "results of 4 workers are in input order");
+
+		// a second batch on the same workers
+		std::vector<std::string> rest(texts.begin(), texts.begin() + 7);
+		ok = pool.parse_all(rest, results) && results.size() == rest.size();
+		for (size_t i=0 ; ok && i<rest.size() ; ++i) {
+			ok = echoed(results[i], rest[i]);
+		}
+		check(ok, "workers are reused for the next batch");
+
+		std::vector<std::string> lines;
+		check(pool.parse("single", lines) && echoed(lines, "single"), "single sentence");
+	}
+
+	{
+		// shell metacharacters reach the worker as plain text; newlines become spaces
+		const char *quoted[] = {
+			"\"double\" and 'single' quotes",
+			"nested \"quotes 'inside' quotes\"",
+			"$HOME `echo x` $(echo y) \\n back\\slash",
+			"  leading and trailing spaces  ",
+		};
+		modality::knp_pool pool(stub, 2);
+		std::vector<std::string> qtexts(quoted, quoted + sizeof(quoted) / sizeof(quoted[0]));
+		bool ok = pool.parse_all(qtexts, results);
+		for (size_t i=0 ; ok && i<qtexts.size() ; ++i) {
+			ok = echoed(results[i], qtexts[i]);
+		}
+		check(ok, "text with quotes and shell metacharacters");
+
+		std::vector<std::string> lines;
+		check(pool.parse("two\nlines", lines) && echoed(lines, "two lines"), "newline in a sentence");
+	}
+
+	{
+		// each worker dies after 3 sentences
+		modality::knp_pool pool(stub + " 3", 2);
+		check(!pool.parse_all(texts, results), "a worker that dies fails the batch");
+	}
+
+	{
+		// the worker dies after 1 sentence
+		modality::knp_pool pool(stub + " 1", 1);
+		std::vector<std::string> lines;
+		bool ok = pool.parse("first", lines) && !pool.parse("second", lines);
+		check(ok && pool.parse("third", lines) && echoed(lines, "third"), "a dead worker is restarted");
+	}
+
+	{
+		modality::knp_pool pool("exit 0", 2);
+		std::vector<std::string> lines;
+		check(!pool.parse("sentence", lines), "a worker that exits at once");
+		struct sigaction sa;
+		sigaction(SIGPIPE, NULL, &sa);
+		check(sa.sa_handler == SIG_DFL, "SIGPIPE of the process is left as it is");
+	}
+
+	return failures == 0 ? 0 : 1;
+}
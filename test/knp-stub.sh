@@ -0,0 +1,14 @@
+#!/bin/sh
+# Stand-in for "juman | knp -tab" in the tests: frames each input line as a
+# KNP result ending with EOS. Workers sleep for different times so that their
+# results come back out of input order. With a number N as the argument, the
+# worker exits after N sentences.
+n=0
+while IFS= read -r line; do
+	if [ -n "$1" ] && [ "$n" -ge "$1" ]; then
+		exit 1
+	fi
+	sleep 0.0$(( $$ % 5 ))
+	printf '# S-ID:%d\n* 0 -1D\n+ 0 -1D\n%s\nEOS\n' "$n" "$line"
+	n=$(( n + 1 ))
+done
@@ -0,0 +1,192 @@
+/*
+ * libzunda from several threads at once:
+ *   libzunda-test <model dir> <dic dir> <CaboCha lattice file>
+ * Every thread analyzes every sentence of the file, starting at a different
+ * sentence; the events are printed as the #EVENT lines of zunda once all the
+ * threads have given the same ones. Exits with 0 on success.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "zunda.h"
+
+#define THREADS 4
+#define MAX_MORPHS 512
+#define MAX_CHUNKS 256
+#define LINE_SIZE 4096
+
+typedef struct {
+	zunda_morph_t morphs[MAX_MORPHS];
+	int heads[MAX_CHUNKS];
+	size_t n_morphs;
+	size_t n_chunks;
+	/* #EVENT lines by thread */
+	char *events[THREADS];
+} sentence_t;
+
+static zunda_t *z;
+static sentence_t *sents;
+static size_t n_sents;
+
+
+static char *copy(const char *s, size_t len) {
+	char *p = malloc(len + 1);
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return p;
+}
+
+
+/* a morpheme line: the surface, a tab and the MeCab feature; the columns
+ * after the feature are ignored */
+static int read_morph(const char *line, int chunk, zunda_morph_t *m) {
+	const char *tab = strchr(line, '\t');
+	char *feat, *fields[9];
+	int n = 0;
+	if (tab == NULL) {
+		return 0;
+	}
+	m->surface = copy(line, tab - line);
+	feat = copy(tab + 1, strcspn(tab + 1, "\t"));
+	fields[n++] = feat;
+	while (n < 9 && (feat = strchr(feat, ',')) != NULL) {
+		*feat++ = '\0';
+		fields[n++] = feat;
+	}
+	if (n < 7) {
+		return 0;
+	}
+	m->pos[0] = fields[0];
+	m->pos[1] = fields[1];
+	m->pos[2] = fields[2];
+	m->pos[3] = fields[3];
+	m->conj_type = fields[4];
+	m->conj_form = fields[5];
+	m->lemma = fields[6];
+	m->reading = (n > 7) ? fields[7] : NULL;
+	m->pron = (n > 8) ? fields[8] : NULL;
+	m->chunk = chunk;
+	return 1;
+}
+
+
+static int read_sentences(const char *path) {
+	char line[LINE_SIZE];
+	size_t max_sents = 64;
+	int chunk = -1;
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "ERROR: cannot open %s\n", path);
+		return 0;
+	}
+	sents = calloc(max_sents, sizeof(sentence_t));
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		sentence_t *s;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] == '\0' || line[0] == '#') {
+			continue;
+		}
+		if (n_sents == max_sents) {
+			sents = realloc(sents, 2 * max_sents * sizeof(sentence_t));
+			memset(sents + max_sents, 0, max_sents * sizeof(sentence_t));
+			max_sents *= 2;
+		}
+		s = &sents[n_sents];
+		if (strcmp(line, "EOS") == 0) {
+			n_sents++;
+			chunk = -1;
+		}
+		else if (line[0] == '*' && line[1] == ' ') {
+			int id, head;
+			if (sscanf(line, "* %d %dD", &id, &head) != 2 || id != chunk + 1 || id >= MAX_CHUNKS) {
+				fprintf(stderr, "ERROR: invalid chunk line: %s\n", line);
+				return 0;
+			}
+			s->heads[id] = head;
+			s->n_chunks = id + 1;
+			chunk = id;
+		}
+		else if (s->n_morphs == MAX_MORPHS || !read_morph(line, chunk, &s->morphs[s->n_morphs++])) {
+			fprintf(stderr, "ERROR: invalid morpheme line: %s\n", line);
+			return 0;
+		}
+	}
+	fclose(fp);
+	return 1;
+}
+
+
+static void *analyze(void *arg) {
+	int t = (int)(size_t)arg;
+	size_t k;
+	for (k=0 ; k<n_sents ; ++k) {
+		sentence_t *s = &sents[(k + t * n_sents / THREADS) % n_sents];
+		zunda_event_t events[MAX_MORPHS];
+		char *buf;
+		size_t len = 0;
+		int n, e, tag;
+		n = zunda_analyze(z, s->morphs, s->n_morphs, s->heads, s->n_chunks, events, MAX_MORPHS);
+		if (n < 0) {
+			continue;
+		}
+		/* labels are far shorter than a line */
+		buf = malloc((n + 1) * LINE_SIZE);
+		buf[0] = '\0';
+		for (e=0 ; e<n ; ++e) {
+			len += sprintf(buf + len, "#EVENT%d\t%d", e, events[e].token);
+			for (tag=0 ; tag<ZUNDA_TAG_NUM ; ++tag) {
+				len += sprintf(buf + len, "\t%s", events[e].tags[tag]);
+			}
+			len += sprintf(buf + len, "\n");
+		}
+		s->events[t] = buf;
+	}
+	return NULL;
+}
+
+
+int main(int argc, char *argv[]) {
+	pthread_t threads[THREADS];
+	size_t i;
+	int t, failures = 0;
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s model_dir dic_dir cabocha_file\n", argv[0]);
+		return 2;
+	}
+	if (!read_sentences(argv[3])) {
+		return 1;
+	}
+	if (n_sents == 0) {
+		fprintf(stderr, "ERROR: no sentences in %s\n", argv[3]);
+		return 1;
+	}
+	z = zunda_new(argv[1], argv[2], ZUNDA_POS_IPA);
+	if (z == NULL) {
+		fprintf(stderr, "ERROR: zunda_new failed\n");
+		return 1;
+	}
+	for (t=0 ; t<THREADS ; ++t) {
+		pthread_create(&threads[t], NULL, analyze, (void *)(size_t)t);
+	}
+	for (t=0 ; t<THREADS ; ++t) {
+		pthread_join(threads[t], NULL);
+	}
+
+	for (i=0 ; i<n_sents ; ++i) {
+		if (sents[i].events[0] == NULL) {
+			fprintf(stderr, "FAIL: sentence %lu is not analyzed\n", (unsigned long)i);
+			++failures;
+			continue;
+		}
+		for (t=1 ; t<THREADS ; ++t) {
+			if (sents[i].events[t] == NULL || strcmp(sents[i].events[0], sents[i].events[t]) != 0) {
+				fprintf(stderr, "FAIL: thread %d differs on sentence %lu\n", t, (unsigned long)i);
+				++failures;
+			}
+		}
+		fputs(sents[i].events[0], stdout);
+	}
+	zunda_destroy(z);
+	return failures == 0 ? 0 : 1;
+}
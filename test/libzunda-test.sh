@@ -0,0 +1,33 @@
+#!/bin/sh
+# libzunda-test against zunda on the sentences of test/depmod, with a model
+# learned from them:
+#   libzunda-test.sh <top srcdir>
+# Run in src/ of the build tree by make check; exits with 0 when the events
+# are the same.
+top=$1
+work=libzunda-test.d
+rm -rf $work
+mkdir -p $work
+
+# zunda and zunda-train do not exit with 0 on success
+./zunda-train -d $top/dic -i 1 -o $work/model -p $top/test/depmod/*.depmod > $work/train.log 2>&1
+if [ ! -f $work/model/model_sentiment ]; then
+	cat $work/train.log
+	echo "FAIL: no model learned"
+	exit 1
+fi
+for f in $top/test/depmod/*.depmod; do
+	grep -v '^#' $f
+done > $work/input.cab
+
+./zunda -d $top/dic -i 1 -m $work/model < $work/input.cab | grep '^#EVENT' > $work/zunda.txt
+./libzunda-test $work/model $top/dic $work/input.cab > $work/libzunda.txt || exit 1
+if [ ! -s $work/zunda.txt ]; then
+	echo "FAIL: zunda gave no events"
+	exit 1
+fi
+if ! diff $work/zunda.txt $work/libzunda.txt; then
+	echo "FAIL: libzunda from 4 threads differs from zunda"
+	exit 1
+fi
+echo "ok: libzunda from 4 threads gives the events of zunda"
@@ -0,0 +1,216 @@
+/*
+ * parser::parse_OC and parse_OW_PB_PN (xml_reader) against the TinyXML-2 DOM
+ * code they replaced:
+ *   xml-reader-test <dic dir> <xml file>...
+ * Files whose name starts with "OC" are read as OC, the others as OW/PB/PN.
+ * Exits with 0 when both give the same tokens and tags for every file.
+ */
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+#include "../tinyxml2/tinyxml2.h"
+#include "modality.hpp"
+
+using modality::t_token;
+
+
+// the DOM reading of the BCCWJ XML before xml_reader
+namespace dom {
+	void parse_modtag_for_sent(tinyxml2::XMLElement *, std::vector< t_token > *);
+
+
+	std::vector<t_token> parse_bccwj_sent(tinyxml2::XMLElement *elemSent, int *sp) {
+		std::vector<t_token> toks;
+
+		if ( std::string(elemSent->Name()) == "sentence" || std::string(elemSent->Name()) == "quote" ) {
+			tinyxml2::XMLElement *elem = elemSent->FirstChildElement("SUW");
+			while (elem) {
+				if (std::string(elem->Name()) == "SUW") {
+					t_token tok;
+					tok.orthToken = elem->Attribute("orthToken");
+					tok.morphID = elem->Attribute("morphID");
+					tok.sp = *sp;
+					tok.ep = tok.sp + tok.orthToken.size() - 1;
+					toks.push_back(tok);
+					*sp = tok.ep + 1;
+				}
+				else if ( std::string(elem->Name()) == "sentence" || std::string(elem->Name()) == "quote" ) {
+					BOOST_FOREACH(t_token tok, parse_bccwj_sent(elem, sp)) {
+						toks.push_back(tok);
+					}
+				}
+				elem = elem->NextSiblingElement();
+			}
+		}
+
+		return toks;
+	}
+
+
+	std::vector< std::vector< t_token > > parse_OC_sents(tinyxml2::XMLElement *elem) {
+		std::vector< std::vector<t_token> > sents;
+
+		tinyxml2::XMLElement *elemWL = elem->FirstChildElement("webLine");
+		while (elemWL) {
+			if (std::string(elemWL->Name()) == "webLine") {
+				tinyxml2::XMLElement *elem = elemWL->FirstChildElement("sentence");
+				while (elem) {
+					if (std::string(elem->Name()) == "sentence") {
+						int sp = 0;
+						std::vector<t_token> sent = parse_bccwj_sent(elem, &sp);
+						parse_modtag_for_sent(elem, &sent);
+						sents.push_back(sent);
+					}
+					elem = elem->NextSiblingElement();
+				}
+			}
+			elemWL = elemWL->NextSiblingElement();
+		}
+
+		return sents;
+	}
+
+
+	void parse_modtag_for_sent(tinyxml2::XMLElement *elemSent, std::vector< t_token > *sent) {
+		while (elemSent) {
+			tinyxml2::XMLElement *elemEME = elemSent->FirstChildElement("eme:event");
+			while (elemEME) {
+				if (std::string(elemEME->Name()) == "eme:event") {
+					// event tag which has required tags, does not contain "OR" in morphIDs
+					if (elemEME->Attribute("eme:orthTokens") &&
+							elemEME->Attribute("eme:morphIDs") &&
+							std::string(elemEME->Attribute("eme:morphIDs")).find("OR")==std::string::npos )
+					{
+						bool use = true;
+						if (elemEME->Attribute("eme:pseudo")) {
+							std::string pseudo = elemEME->Attribute("eme:pseudo");
+							if (pseudo == "機能語" || pseudo == "副詞" || pseudo == "連体詞" || pseudo == "名詞" || pseudo == "感嘆詞" || pseudo == "比況" || pseudo == "解析誤り") {
+								use = false;
+							}
+							else if (pseudo == "名詞-事象可能") {
+								use = false;
+							}
+						}
+
+						if (use) {
+							std::string orthToken = elemEME->Attribute("eme:orthTokens");
+							std::vector<std::string> buf;
+							boost::algorithm::split(buf, orthToken, boost::algorithm::is_any_of(","));
+							orthToken = buf[0];
+
+							std::string morphID = elemEME->Attribute("eme:morphIDs");
+							boost::algorithm::split(buf, morphID, boost::algorithm::is_any_of(","));
+							morphID = buf[buf.size()-1];
+
+							std::vector< t_token >::iterator it_tok;
+							for (it_tok=sent->begin() ; it_tok!=sent->end() ; ++it_tok) {
+								if (it_tok->morphID == morphID) {
+									const tinyxml2::XMLAttribute *attr = elemEME->FirstAttribute();
+									while (attr) {
+										std::string attr_name = attr->Name();
+										boost::algorithm::split(buf, attr_name, boost::algorithm::is_any_of(":"));
+										attr_name = buf[buf.size()-1];
+
+										it_tok->eme[attr_name] = std::string(attr->Value());
+										attr = attr->Next();
+									}
+								}
+							}
+						}
+					}
+				}
+				elemEME = elemEME->NextSiblingElement();
+			}
+			elemSent = elemSent->NextSiblingElement();
+		}
+	}
+
+
+	std::vector< std::vector< t_token > > parse_OC(std::string xml_path) {
+		tinyxml2::XMLDocument doc;
+		doc.LoadFile(xml_path.c_str());
+
+		tinyxml2::XMLElement *elemQ = doc.FirstChildElement("sample")->FirstChildElement("OCQuestion");
+		tinyxml2::XMLElement *elemA = doc.FirstChildElement("sample")->FirstChildElement("OCAnswer");
+		std::vector< std::vector<t_token> > sentsQ = parse_OC_sents( elemQ );
+		std::vector< std::vector<t_token> > sentsA = parse_OC_sents( elemA );
+		sentsQ.insert(sentsQ.end(), sentsA.begin(), sentsA.end());
+		return sentsQ;
+	}
+
+
+	std::vector< std::vector< t_token > > parse_OW_PB_PN(std::string xml_path) {
+		tinyxml2::XMLDocument doc;
+		doc.LoadFile(xml_path.c_str());
+
+		tinyxml2::XMLElement *elem = doc.FirstChildElement("mergedSample");
+		tinyxml2::XMLElement *elemSent = elem->FirstChildElement("sentence");
+		std::vector< std::vector<t_token> > sents;
+		while (elemSent) {
+			if (std::string(elemSent->Name()) == "sentence") {
+				int sp = 0;
+				std::vector<t_token> sent = parse_bccwj_sent(elemSent, &sp);
+				parse_modtag_for_sent(elemSent, &sent);
+				sents.push_back(sent);
+			}
+			elemSent = elemSent->NextSiblingElement();
+		}
+		return sents;
+	}
+};
+
+
+// one line per token with its tags in name order
+std::string dump(const std::vector< std::vector< t_token > > &sents) {
+	std::stringstream ss;
+	for (size_t i=0 ; i<sents.size() ; ++i) {
+		ss << "# sentence " << i << std::endl;
+		BOOST_FOREACH (const t_token &tok, sents[i]) {
+			ss << tok.orthToken << "\t" << tok.morphID << "\t" << tok.sp << "\t" << tok.ep;
+			std::map< std::string, std::string > eme(tok.eme.begin(), tok.eme.end());
+			for (std::map< std::string, std::string >::iterator it=eme.begin() ; it!=eme.end() ; ++it) {
+				ss << "\t" << it->first << "=" << it->second;
+			}
+			ss << std::endl;
+		}
+	}
+	return ss.str();
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		std::cerr << "usage: " << argv[0] << " dic_dir xml_file..." << std::endl;
+		return 2;
+	}
+	modality::parser mod_parser(MODELDIR_IPA, argv[1]);
+
+	int failures = 0;
+	for (int i=2 ; i<argc ; ++i) {
+		std::string file = argv[i];
+		std::string expected, actual;
+		if (boost::filesystem::path(file).filename().string().compare(0, 2, "OC") == 0) {
+			expected = dump(dom::parse_OC(file));
+			actual = dump(mod_parser.parse_OC(file));
+		}
+		else {
+			expected = dump(dom::parse_OW_PB_PN(file));
+			actual = dump(mod_parser.parse_OW_PB_PN(file));
+		}
+		if (expected == actual) {
+			std::cout << "ok: " << file << std::endl;
+		}
+		else {
+			std::cout << "FAIL: " << file << std::endl;
+			std::cout << "--- TinyXML-2" << std::endl << expected;
+			std::cout << "--- xml_reader" << std::endl << actual;
+			++failures;
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}